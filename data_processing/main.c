@@ -1,10 +1,244 @@
+#define _GNU_SOURCE   /* MAP_POPULATE, madvise, strdup */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#endif
+
+/* ============================
+   Sort Engine Settings
+   ============================ */
+#define SORT_DESCENDING   1          /* flag for sort_dataset() */
+#define INSERTION_SORT_MAX 16        /* introsort hands smaller runs to insertion sort */
+#define RADIX_SORT_MIN    256        /* below this introsort beats the radix passes */
+#define PARALLEL_SORT_MIN (1 << 20)  /* elements before radix passes use threads */
+#define MAX_THREADS       16
+
+/* ============================
+   Loader Settings
+   ============================ */
+#define PARALLEL_PARSE_MIN (4 << 20) /* file bytes before parsing uses threads */
+
+/* ============================
+   Binary Column Format
+   ============================ */
+#define COLUMN_MAGIC        "DCOL"
+#define COLUMN_VERSION      1
+#define COLUMN_INT32        1
+#define COLUMN_INT64        2
+#define COLUMN_COMPRESSED   1        /* header flag: delta + varint blocks */
+#define COLUMN_BLOCK_VALUES 65536
+#define COLUMN_DATA_OFFSET  64       /* blocks start after a padded header */
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t type;             /* COLUMN_INT32 or COLUMN_INT64 */
+    uint32_t flags;
+    uint64_t count;
+    uint64_t blockCount;
+    uint64_t blockIndexOffset; /* ColumnBlock[blockCount] footer */
+    uint64_t fileBytes;
+    uint32_t blockValues;
+    uint32_t reserved;
+} ColumnHeader;
+
+typedef struct {
+    uint64_t offset;
+    uint32_t bytes;
+    uint32_t count;
+    int64_t min;
+    int64_t max;
+} ColumnBlock;
+
+/* A column file being written block by block */
+typedef struct {
+    FILE *fp;
+    uint32_t type;
+    int compress;
+    ColumnBlock *blocks;
+    size_t blockCount;
+    size_t blockCapacity;
+    void *pending;             /* values of the block being filled */
+    size_t pendingCount;
+    unsigned char *buffer;     /* encoded block */
+    uint64_t offset;
+    uint64_t count;
+} ColumnWriter;
+
+/* An open, memory-mapped column file */
+typedef struct {
+    const ColumnHeader *header;
+    const ColumnBlock *blocks;
+    const unsigned char *base;
+    size_t bytes;
+} Column;
+
+/* ============================
+   Value Types
+   ============================ */
+typedef enum { TYPE_INT32, TYPE_INT64, TYPE_FLOAT, TYPE_DOUBLE, TYPE_COUNT } ValueType;
+
+/* One value of any type; each kernel uses the member for its own */
+typedef union {
+    int32_t i32;
+    int64_t i64;
+    float f32;
+    double f64;
+} TypedValue;
+
+/* Summary of a dataset of any type; min and max keep that type */
+typedef struct {
+    size_t count;
+    long double sum;       /* exact for int64 sums, no overflow */
+    double mean;
+    TypedValue min;
+    TypedValue max;
+} TypedSummary;
+
+/* ============================
+   Dataset Container
+   ============================ */
+/* Search index slot: a distinct value, its first index and count */
+typedef struct {
+    int key;
+    int count;             /* 0 = empty slot */
+    size_t first;
+} IndexSlot;
+
+typedef struct {
+    int valid;
+    size_t n;
+    IndexSlot *slots;
+    size_t mask;
+    int *tree;             /* Eytzinger order, 1-based */
+    size_t *rank;          /* sorted position of each tree node */
+} SearchIndex;
+
+/* Sum and extremes, kept current by every edit once first computed */
+typedef struct {
+    int valid;
+    int stale;             /* an extreme was deleted: rescan on demand */
+    long long sum;
+    int min;
+    int max;
+    size_t minCount;       /* occurrences of min and max */
+    size_t maxCount;
+} RunningStats;
+
+#define SKETCH_K          200   /* rank error is roughly 1.7 / SKETCH_K */
+#define SKETCH_MAX_LEVELS 48
+
+typedef struct {
+    int value;
+    uint64_t rank;         /* weight of this item and every smaller one */
+} SketchItem;
+
+/* KLL quantile sketch: level h holds items standing for 2^h values */
+typedef struct {
+    int valid;
+    int *level[SKETCH_MAX_LEVELS];
+    uint32_t size[SKETCH_MAX_LEVELS];
+    uint32_t room[SKETCH_MAX_LEVELS];
+    int levels;
+    size_t items;
+    size_t limit;          /* total items before a level is compacted */
+    uint64_t n;
+    uint64_t rng;
+    SketchItem *view;      /* sorted items, rebuilt after updates */
+    size_t viewCount;
+    int viewValid;
+} QuantileSketch;
+
+/* Median, percentiles and top-k: a sorted copy, or a sketch */
+typedef struct {
+    int approximate;
+    int valid;             /* sorted copy matches the values */
+    int *sorted;
+    size_t size;
+    size_t capacity;
+    QuantileSketch sketch;
+} OrderStats;
+
+#define DATASET_MIN_CAPACITY 16
+
+/*
+ * Values of one type, packed. The search index, running statistics and
+ * order statistics are int32 features; other types go through the
+ * per-type kernels on each query.
+ *
+ * Values loaded from a raw column file stay in its copy-on-write
+ * mapping until the dataset has to grow; until the first edit the
+ * column's block footer also answers min, max and search.
+ */
+typedef struct {
+    ValueType type;
+    union {
+        int *values;       /* TYPE_INT32 */
+        void *data;        /* any type */
+    };
+    size_t size;
+    size_t capacity;
+    SearchIndex index;     /* built lazily, dropped by every edit */
+    RunningStats stats;
+    OrderStats order;
+    Column column;         /* column file the values were loaded from */
+    int columnCurrent;     /* values still match the column's footer */
+} Dataset;
+
+typedef enum { CMP_LT, CMP_LE, CMP_GT, CMP_GE, CMP_EQ, CMP_NE } Comparison;
+
+/* A condition such as ">0", used by filters and batched deletes */
+typedef struct {
+    Comparison cmp;
+    long long operand;
+} Condition;
+
+typedef int (*value_predicate)(int value, const void *ctx);
 
 /* ============================
    Function Pointer Typedefs
    ============================ */
-typedef void (*operation_func)(int *, int);
+typedef void (*operation_func)(Dataset *);
+
+/* Everything one pass over the data can tell us */
+typedef struct {
+    size_t count;
+    long long sum;      /* 64-bit: cannot overflow below 2^32 values */
+    double mean;
+    int min;
+    int max;
+} Summary;
+
+typedef void (*describe_func)(const int *, size_t, Summary *);
+
+/* One type's kernels; see "Typed Kernels" */
+typedef struct {
+    const char *name;
+    size_t width;
+    int integer;           /* sums print without decimals */
+    void (*describe)(const void *data, size_t n, TypedSummary *out);
+    void (*sort)(void *data, size_t n, int flags);
+    size_t (*find)(const void *data, size_t n, const TypedValue *value, size_t *first);
+    double (*get)(const void *data, size_t i);
+    int (*parse)(const char *text, TypedValue *out);
+    int (*format)(const void *data, size_t i, char *buf, size_t len);
+    int (*load_text)(const char *filename, void **out, size_t *count);
+    int (*write_text)(FILE *fp, const void *data, size_t n);
+} TypeKernels;
 
 /* ============================
    Utility Function Prototypes
@@ -13,29 +247,133 @@ void print_menu();
 void print_operations_menu();
 
 /* Dataset operations */
-void sum(int *data, int size);
-void average(int *data, int size);
-void find_min(int *data, int size);
-void find_max(int *data, int size);
-void sort_asc(int *data, int size);
-void sort_desc(int *data, int size);
-void search_value(int *data, int size);
+void sum(Dataset *ds);
+void average(Dataset *ds);
+void find_min(Dataset *ds);
+void find_max(Dataset *ds);
+void sort_asc(Dataset *ds);
+void sort_desc(Dataset *ds);
+void search_value(Dataset *ds);
+void describe(Dataset *ds);
+void range_query(Dataset *ds);
+void batch_search(Dataset *ds);
+void median(Dataset *ds);
+void percentile(Dataset *ds);
+void top_k(Dataset *ds);
+void order_mode(Dataset *ds);
+
+/* Dataset container */
+int dataset_reserve(Dataset *ds, size_t capacity);
+int dataset_append(Dataset *ds, int value);
+int dataset_append_bulk(Dataset *ds, const void *values, size_t n);
+void dataset_adopt(Dataset *ds, ValueType type, void *values, size_t n);
+int dataset_adopt_column(Dataset *ds, Column *col);
+int dataset_detach(Dataset *ds, size_t capacity);
+size_t dataset_delete_indices(Dataset *ds, const size_t *indices, size_t k);
+size_t dataset_delete_if(Dataset *ds, value_predicate pred, const void *ctx);
+void dataset_set(Dataset *ds, size_t i, int value);
+void dataset_store(Dataset *ds, size_t i, const TypedValue *value);
+void dataset_changed(Dataset *ds);
+void dataset_free(Dataset *ds);
+int parse_condition(const char *text, Condition *cond);
+int condition_matches(int value, const void *cond);
+
+/* Running statistics */
+void dataset_summary(Dataset *ds, Summary *out);
+void dataset_typed_summary(Dataset *ds, TypedSummary *out);
+int dataset_quantile(Dataset *ds, double q, double *out);
+size_t dataset_top_k(Dataset *ds, size_t k, void *result);
+void dataset_order_mode(Dataset *ds, int approximate);
+
+/* Typed kernels */
+const TypeKernels *kernels_for(const Dataset *ds);
+int read_value_type(ValueType *type);
+int read_typed_value(const Dataset *ds, TypedValue *value);
+
+/* Search index */
+void index_invalidate(SearchIndex *ix);
+int index_lookup(Dataset *ds, int value, size_t *first, size_t *count);
+size_t index_lookup_batch(Dataset *ds, const int *queries, size_t q, long long *first);
+int index_lower_bound(Dataset *ds, int value, int *found, size_t *rank);
+
+/* Text loader */
+int load_text_dataset(const char *filename, int **out, size_t *count);
+
+/* Binary column files */
+int column_writer_open(ColumnWriter *w, const char *filename, uint32_t type, int compress);
+int column_writer_append(ColumnWriter *w, const void *values, size_t n);
+int column_writer_close(ColumnWriter *w);
+int column_write(const char *filename, const void *data, size_t n, uint32_t type, int compress);
+int column_open(Column *col, const char *filename);
+void column_close(Column *col);
+const int *column_values(const Column *col);
+int column_read_block(const Column *col, size_t block, int *out);
+int column_read_block64(const Column *col, size_t block, int64_t *out);
+int column_load(const char *filename, int **out, size_t *count);
+int column_load_typed(const char *filename, ValueType *type, void **out, size_t *count);
+int64_t column_min(const Column *col);
+int64_t column_max(const Column *col);
+long long column_find(const Column *col, int64_t value, size_t *count);
+
+/* Batch pipeline */
+int text_write_values(FILE *fp, const int *values, size_t n);
+int run_pipeline(const char *spec);
+
+/* Benchmarks */
+int run_benchmark(size_t maxElements, const char *baselineFile, double tolerance);
+
+/* Reduction kernels */
+void describe_dataset(const int *data, size_t n, Summary *out);
+const char *describe_kernel_name(void);
+
+/* Sort engine */
+void sort_dataset(int *data, size_t n, int flags);
 
 /* File operations */
-void load_from_file(int **data, int *size);
-void save_to_file(int *data, int size);
+void load_from_file(Dataset *ds);
+void append_from_file(Dataset *ds);
+void save_to_file(Dataset *ds);
 
 /* Dataset functions */
-void view_dataset(int *data, int size);
-void add_value(int **data, int *size);
-void modify_value(int *data, int size);
-void delete_value(int **data, int *size);
+void view_dataset(Dataset *ds);
+void add_value(Dataset *ds);
+void modify_value(Dataset *ds);
+void delete_value(Dataset *ds);
+void delete_matching(Dataset *ds);
+void new_dataset(Dataset *ds);
 
    // Main Program
 
-int main() {
-    int *data = NULL;
-    int size = 0;
+int main(int argc, char *argv[]) {
+    if (argc == 3 && strcmp(argv[1], "--pipeline") == 0)
+        return run_pipeline(argv[2]);
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+        size_t maxElements = 0;          /* default size */
+        const char *baseline = NULL;
+        double tolerance = 10.0;
+        int ok = 1;
+        for (int i = 2; i < argc && ok; i++) {
+            if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+                baseline = argv[++i];
+            else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+                tolerance = strtod(argv[++i], NULL);
+            else if (i == 2 && argv[i][0] != '-')
+                ok = (maxElements = (size_t)strtoull(argv[i], NULL, 10)) > 0;
+            else
+                ok = 0;
+        }
+        if (ok)
+            return run_benchmark(maxElements, baseline, tolerance);
+    }
+    if (argc > 1) {
+        printf("Usage: %s [--pipeline \"load <file> | filter >0 | sort | describe | save <file>\"]\n",
+               argv[0]);
+        printf("       %s --bench [<max elements>] [--baseline <file>] [--tolerance <pct>]\n",
+               argv[0]);
+        return 1;
+    }
+
+    Dataset ds = { 0 };
     int choice;
 
     operation_func operations[] = {
@@ -45,7 +383,14 @@ int main() {
         find_max,
         sort_asc,
         sort_desc,
-        search_value
+        search_value,
+        describe,
+        range_query,
+        batch_search,
+        median,
+        percentile,
+        top_k,
+        order_mode
     };
 
     int num_operations = sizeof(operations) / sizeof(operations[0]);
@@ -56,16 +401,16 @@ int main() {
 
         switch (choice) {
             case 1:
-                add_value(&data, &size);
+                add_value(&ds);
                 break;
             case 2:
-                modify_value(data, size);
+                modify_value(&ds);
                 break;
             case 3:
-                delete_value(&data, &size);
+                delete_value(&ds);
                 break;
             case 4:
-                view_dataset(data, size);
+                view_dataset(&ds);
                 break;
             case 5: {
                 print_operations_menu();
@@ -73,22 +418,31 @@ int main() {
                 scanf("%d", &op);
 
                 if (op >= 1 && op <= num_operations) {
-                    operations[op - 1](data, size);
+                    operations[op - 1](&ds);
                 } else {
                     printf("Invalid operation\n");
                 }
                 break;
             }
             case 6:
-                load_from_file(&data, &size);
+                load_from_file(&ds);
                 break;
             case 7:
-                save_to_file(data, size);
+                save_to_file(&ds);
                 break;
             case 8:
-                free(data);
+                dataset_free(&ds);
                 printf("Exiting program...\n");
                 return 0;
+            case 9:
+                delete_matching(&ds);
+                break;
+            case 10:
+                append_from_file(&ds);
+                break;
+            case 11:
+                new_dataset(&ds);
+                break;
             default:
                 printf("Invalid menu option.\n");
         }
@@ -109,6 +463,9 @@ void print_menu() {
     printf("6. Load data from file\n");
     printf("7. Save data to file\n");
     printf("8. Exit\n");
+    printf("9. Delete values matching a condition\n");
+    printf("10. Append values from file\n");
+    printf("11. Start a new dataset of another value type\n");
     printf("Choose an option: ");
 }
 
@@ -121,192 +478,3877 @@ void print_operations_menu() {
     printf("5. Sort ascending\n");
     printf("6. Sort descending\n");
     printf("7. Search for a value\n");
+    printf("8. Describe (count, sum, mean, min, max)\n");
+    printf("9. Count values in a range\n");
+    printf("10. Batch search (values from a file)\n");
+    printf("11. Median\n");
+    printf("12. Percentile\n");
+    printf("13. Top-k largest values\n");
+    printf("14. Switch exact / approximate order statistics\n");
     printf("Choose an operation: ");
 }
 
 //     Dataset Operations
-void view_dataset(int *data, int size) {
-    if (size == 0) {
+
+/* Formats one value, or a sum, of the dataset's type */
+static const char *format_value(const Dataset *ds, const TypedValue *value, char *buf, size_t len) {
+    kernels_for(ds)->format(value, 0, buf, len);
+    return buf;
+}
+
+static const char *format_sum(const Dataset *ds, const TypedSummary *s, char *buf, size_t len) {
+    snprintf(buf, len, kernels_for(ds)->integer ? "%.0Lf" : "%.10Lg", s->sum);
+    return buf;
+}
+
+void view_dataset(Dataset *ds) {
+    if (ds->size == 0) {
         printf("Dataset is empty.\n");
         return;
     }
 
-    printf("\n--- Current Dataset (%d values) ---\n", size);
-    for (int i = 0; i < size; i++) {
-        printf("[%d] = %d\n", i, data[i]);
+    const TypeKernels *k = kernels_for(ds);
+    char text[64];
+    printf("\n--- Current Dataset (%zu %s values) ---\n", ds->size, k->name);
+    for (size_t i = 0; i < ds->size; i++) {
+        k->format(ds->data, i, text, sizeof(text));
+        printf("[%zu] = %s\n", i, text);
     }
     printf("-----------------------------------\n");
 }
 
-void sum(int *data, int size) {
-    if (size == 0) { printf("Dataset empty.\n"); return; }
-    int sum = 0;
-    for (int i = 0; i < size; i++) sum += data[i];
-    printf("Sum = %d\n", sum);
+void sum(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    TypedSummary s;
+    char text[64];
+    dataset_typed_summary(ds, &s);
+    printf("Sum = %s\n", format_sum(ds, &s, text, sizeof(text)));
 }
 
-void average(int *data, int size) {
-    if (size == 0) { printf("Dataset empty.\n"); return; }
-    int sum = 0;
-    for (int i = 0; i < size; i++) sum += data[i];
-    printf("Average = %.2f\n", (float)sum / size);
+void average(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    TypedSummary s;
+    dataset_typed_summary(ds, &s);
+    printf("Average = %.2f\n", s.mean);
 }
 
-void find_min(int *data, int size) {
-    if (size == 0) { printf("Dataset empty.\n"); return; }
-    int min = data[0];
-    for (int i = 1; i < size; i++)
-        if (data[i] < min) min = data[i];
-    printf("Minimum value = %d\n", min);
+/* Min or max from the column footer while the values are as loaded; -1 otherwise */
+static int column_extreme(const Dataset *ds, int max, TypedValue *out) {
+    if (!ds->columnCurrent)
+        return -1;
+    int64_t v = max ? column_max(&ds->column) : column_min(&ds->column);
+    if (ds->type == TYPE_INT64)
+        out->i64 = v;
+    else
+        out->i32 = (int32_t)v;
+    return 0;
 }
 
-void find_max(int *data, int size) {
-    if (size == 0) { printf("Dataset empty.\n"); return; }
-    int max = data[0];
-    for (int i = 1; i < size; i++)
-        if (data[i] > max) max = data[i];
-    printf("Maximum value = %d\n", max);
+void find_min(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    TypedValue min;
+    char text[64];
+    if (column_extreme(ds, 0, &min) != 0) {
+        TypedSummary s;
+        dataset_typed_summary(ds, &s);
+        min = s.min;
+    }
+    printf("Minimum value = %s\n", format_value(ds, &min, text, sizeof(text)));
 }
 
-void sort_asc(int *data, int size) {
-    if (size == 0) { printf("Dataset empty.\n"); return; }
-    for (int i = 0; i < size - 1; i++)
-        for (int j = 0; j < size - i - 1; j++)
-            if (data[j] > data[j + 1]) {
-                int tmp = data[j];
-                data[j] = data[j + 1];
-                data[j + 1] = tmp;
-            }
+void find_max(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    TypedValue max;
+    char text[64];
+    if (column_extreme(ds, 1, &max) != 0) {
+        TypedSummary s;
+        dataset_typed_summary(ds, &s);
+        max = s.max;
+    }
+    printf("Maximum value = %s\n", format_value(ds, &max, text, sizeof(text)));
+}
+
+void describe(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    TypedSummary s;
+    char text[64];
+    dataset_typed_summary(ds, &s);
+    printf("Type    = %s\n", kernels_for(ds)->name);
+    printf("Count   = %zu\n", s.count);
+    printf("Sum     = %s\n", format_sum(ds, &s, text, sizeof(text)));
+    printf("Mean    = %.2f\n", s.mean);
+    printf("Minimum = %s\n", format_value(ds, &s.min, text, sizeof(text)));
+    printf("Maximum = %s\n", format_value(ds, &s.max, text, sizeof(text)));
+}
+
+void sort_asc(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    kernels_for(ds)->sort(ds->data, ds->size, 0);
+    dataset_changed(ds);
     printf("Sorted ascending.\n");
 }
 
-void sort_desc(int *data, int size) {
-    if (size == 0) { printf("Dataset empty.\n"); return; }
-    for (int i = 0; i < size - 1; i++)
-        for (int j = 0; j < size - i - 1; j++)
-            if (data[j] < data[j + 1]) {
-                int tmp = data[j];
-                data[j] = data[j + 1];
-                data[j + 1] = tmp;
-            }
+void sort_desc(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    kernels_for(ds)->sort(ds->data, ds->size, SORT_DESCENDING);
+    dataset_changed(ds);
     printf("Sorted descending.\n");
 }
 
-void search_value(int *data, int size) {
-    if (size == 0) { printf("Dataset empty.\n"); return; }
-    int val;
+void search_value(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    TypedValue val;
+    char text[64];
     printf("Enter value to search: ");
-    scanf("%d", &val);
+    if (read_typed_value(ds, &val) != 0) {
+        printf("Invalid value.\n");
+        return;
+    }
 
-    for (int i = 0; i < size; i++) {
-        if (data[i] == val) {
-            printf("Value %d found at index %d.\n", val, i);
-            return;
-        }
+    /*
+     * A freshly loaded column skips blocks by their footer range, int32
+     * goes through the search index, other types scan.
+     */
+    size_t first, count;
+    if (ds->columnCurrent && !ds->index.valid) {
+        long long at = column_find(&ds->column, ds->type == TYPE_INT64 ? val.i64 : val.i32, &count);
+        first = at < 0 ? 0 : (size_t)at;
+    } else if (ds->type == TYPE_INT32) {
+        if (index_lookup(ds, val.i32, &first, &count) != 0)
+            count = 0;
+    } else {
+        count = kernels_for(ds)->find(ds->data, ds->size, &val, &first);
     }
-    printf("Value not found.\n");
+
+    format_value(ds, &val, text, sizeof(text));
+    if (count == 0)
+        printf("Value not found.\n");
+    else if (count > 1)
+        printf("Value %s found at index %zu (%zu occurrences).\n", text, first, count);
+    else
+        printf("Value %s found at index %zu.\n", text, first);
 }
 
-//   Dataset Editing
+/* Range counts and batch search run on the int32 index */
+static int needs_int32(const Dataset *ds) {
+    if (ds->type == TYPE_INT32)
+        return 0;
+    printf("This operation needs an int32 dataset (this one is %s).\n", kernels_for(ds)->name);
+    return -1;
+}
 
-void add_value(int **data, int *size) {
-    int new_val;
-    printf("Enter value to add: ");
-    scanf("%d", &new_val);
+void range_query(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    if (needs_int32(ds) != 0)
+        return;
+    int lo, hi;
+    printf("Enter lower and upper bound: ");
+    scanf("%d %d", &lo, &hi);
 
-    *data = realloc(*data, (*size + 1) * sizeof(int));
-    (*data)[*size] = new_val;
-    (*size)++;
+    int found;
+    size_t from, to;
+    if (index_lower_bound(ds, lo, &found, &from) != 0) {
+        printf("Not enough memory for the index.\n");
+        return;
+    }
+    if (hi < lo || from == ds->size || found > hi) {
+        printf("No values in [%d, %d].\n", lo, hi);
+        return;
+    }
+    if (hi == INT_MAX) {
+        to = ds->size;
+    } else {
+        int next;
+        index_lower_bound(ds, hi + 1, &next, &to);
+    }
+    printf("%zu values in [%d, %d]; smallest is %d.\n", to - from, lo, hi, found);
+}
 
-    printf("Value added.\n");
+static const char *order_mode_name(const Dataset *ds) {
+    return ds->order.approximate && ds->type == TYPE_INT32 ? "approximate" : "exact";
 }
 
-void modify_value(int *data, int size) {
-    if (size == 0) { printf("Dataset empty.\n"); return; }
-    int index, new_val;
+void median(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    double m;
+    if (dataset_quantile(ds, 0.5, &m) != 0) {
+        printf("Not enough memory.\n");
+        return;
+    }
+    printf("Median = %.2f (%s)\n", m, order_mode_name(ds));
+}
 
-    printf("Enter index to modify (0-%d): ", size - 1);
-    scanf("%d", &index);
+void percentile(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    double p, v;
+    printf("Enter percentile (0-100): ");
+    scanf("%lf", &p);
+    if (!(p >= 0 && p <= 100)) {
+        printf("Invalid percentile.\n");
+        return;
+    }
+    if (dataset_quantile(ds, p / 100.0, &v) != 0) {
+        printf("Not enough memory.\n");
+        return;
+    }
+    printf("P%g = %.2f (%s)\n", p, v, order_mode_name(ds));
+}
 
-    if (index < 0 || index >= size) {
-        printf("Invalid index.\n");
+void top_k(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    long long k;
+    printf("How many values: ");
+    scanf("%lld", &k);
+    if (k <= 0) {
+        printf("Invalid count.\n");
         return;
     }
+    if ((size_t)k > ds->size)
+        k = (long long)ds->size;
 
-    printf("Enter new value: ");
-    scanf("%d", &new_val);
-    data[index] = new_val;
+    const TypeKernels *kern = kernels_for(ds);
+    void *top = malloc((size_t)k * kern->width);
+    size_t got = top ? dataset_top_k(ds, (size_t)k, top) : 0;
+    if (got == 0) {
+        free(top);
+        printf("Not enough memory.\n");
+        return;
+    }
+    char text[64];
+    printf("Top %zu:", got);
+    for (size_t i = 0; i < got; i++) {
+        kern->format(top, i, text, sizeof(text));
+        printf(" %s", text);
+    }
+    printf("\n");
+    free(top);
+}
 
-    printf("Value updated.\n");
+void order_mode(Dataset *ds) {
+    if (needs_int32(ds) != 0)
+        return;
+    dataset_order_mode(ds, !ds->order.approximate);
+    printf("Order statistics are now %s.\n", order_mode_name(ds));
 }
 
-void delete_value(int **data, int *size) {
-    if (*size == 0) { printf("Dataset empty.\n"); return; }
+void batch_search(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    if (needs_int32(ds) != 0)
+        return;
+    char filename[100];
+    printf("Enter file of values to search: ");
+    scanf("%99s", filename);
 
-    int index;
-    printf("Enter index to delete (0-%d): ", *size - 1);
-    scanf("%d", &index);
+    int *queries;
+    size_t q;
+    if (load_text_dataset(filename, &queries, &q) != 0) {
+        printf("Failed to open file.\n");
+        return;
+    }
 
-    if (index < 0 || index >= *size) {
-        printf("Invalid index.\n");
+    long long *first = malloc((q ? q : 1) * sizeof(long long));
+    if (!first) {
+        free(queries);
+        printf("Not enough memory.\n");
         return;
     }
 
-    for (int i = index; i < *size - 1; i++)
-        (*data)[i] = (*data)[i + 1];
+    size_t hits = index_lookup_batch(ds, queries, q, first);
+    printf("%zu of %zu values found.\n", hits, q);
+    for (size_t i = 0; i < q && i < 10; i++) {
+        if (first[i] >= 0)
+            printf("  %d at index %lld\n", queries[i], first[i]);
+        else
+            printf("  %d not found\n", queries[i]);
+    }
+    if (q > 10)
+        printf("  ...\n");
+
+    free(first);
+    free(queries);
+}
+
+/* ============================
+   Threads
+   ============================ */
+int available_threads(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus < 1 ? 1 : cpus > MAX_THREADS ? MAX_THREADS : (int)cpus;
+}
 
-    *data = realloc(*data, (*size - 1) * sizeof(int));
-    (*size)--;
+/* Runs `fn` over `count` work items of `size` bytes each, one thread
+   per item. An item whose thread cannot be started runs on the caller
+   instead, so a failed pthread_create only costs speed. */
+void run_parallel(void *(*fn)(void *), void *items, size_t size, int count) {
+    pthread_t tids[MAX_THREADS];
+    int started[MAX_THREADS];
+    char *base = items;
 
-    printf("Value deleted.\n");
+    for (int t = 1; t < count; t++)
+        started[t] = pthread_create(&tids[t], NULL, fn, base + (size_t)t * size) == 0;
+    fn(base);
+    for (int t = 1; t < count; t++) {
+        if (started[t])
+            pthread_join(tids[t], NULL);
+        else
+            fn(base + (size_t)t * size);
+    }
 }
 
 /* ============================
-   File I/O
+   Sort Engine
    ============================ */
+/*
+ * Every value is compared through an unsigned key: flipping the sign
+ * bit makes signed order match unsigned order, and flipping the other
+ * 31 bits instead reverses it. Descending is therefore just a
+ * different flip mask on the same code paths.
+ *
+ * Large arrays use an LSD radix sort (four byte-wide passes, skipping
+ * any pass where every key shares the same byte), split across threads
+ * above PARALLEL_SORT_MIN. Small arrays, or a failed scratch
+ * allocation, fall back to an in-place introsort.
+ */
+static inline uint32_t sort_key(int value, uint32_t flip) {
+    return (uint32_t)value ^ flip;
+}
 
-void load_from_file(int **data, int *size) {
-    char filename[100];
-    printf("Enter filename to load: ");
-    scanf("%s", filename);
+static void insertion_sort(int *a, size_t n, uint32_t flip) {
+    for (size_t i = 1; i < n; i++) {
+        int value = a[i];
+        uint32_t key = sort_key(value, flip);
+        size_t j = i;
+        while (j > 0 && sort_key(a[j - 1], flip) > key) {
+            a[j] = a[j - 1];
+            j--;
+        }
+        a[j] = value;
+    }
+}
 
-    FILE *fp = fopen(filename, "r");
-    if (!fp) {
-        printf("Failed to open file.\n");
-        return;
+static void sift_down(int *a, size_t root, size_t n, uint32_t flip) {
+    int value = a[root];
+    uint32_t key = sort_key(value, flip);
+    for (;;) {
+        size_t child = 2 * root + 1;
+        if (child >= n)
+            break;
+        if (child + 1 < n && sort_key(a[child + 1], flip) > sort_key(a[child], flip))
+            child++;
+        if (sort_key(a[child], flip) <= key)
+            break;
+        a[root] = a[child];
+        root = child;
+    }
+    a[root] = value;
+}
+
+static void heap_sort(int *a, size_t n, uint32_t flip) {
+    for (size_t i = n / 2; i-- > 0; )
+        sift_down(a, i, n, flip);
+    for (size_t end = n; end-- > 1; ) {
+        int tmp = a[0];
+        a[0] = a[end];
+        a[end] = tmp;
+        sift_down(a, 0, end, flip);
     }
+}
+
+/* Quicksort with a median-of-three pivot, switching to heapsort once
+   `depth` runs out so adversarial input stays O(n log n). */
+static void intro_sort(int *a, size_t n, int depth, uint32_t flip) {
+    while (n > INSERTION_SORT_MAX) {
+        if (depth-- == 0) {
+            heap_sort(a, n, flip);
+            return;
+        }
+
+        uint32_t k0 = sort_key(a[0], flip);
+        uint32_t k1 = sort_key(a[n / 2], flip);
+        uint32_t k2 = sort_key(a[n - 1], flip);
+        uint32_t pivot = k0 < k1 ? (k1 < k2 ? k1 : (k0 < k2 ? k2 : k0))
+                                 : (k0 < k2 ? k0 : (k1 < k2 ? k2 : k1));
 
-    int temp, count = 0;
-    int *buffer = NULL;
+        /* Hoare partition: a[0..j] <= pivot <= a[j+1..n-1] */
+        ptrdiff_t i = -1, j = (ptrdiff_t)n;
+        for (;;) {
+            do i++; while (sort_key(a[i], flip) < pivot);
+            do j--; while (sort_key(a[j], flip) > pivot);
+            if (i >= j)
+                break;
+            int tmp = a[i];
+            a[i] = a[j];
+            a[j] = tmp;
+        }
 
-    while (fscanf(fp, "%d", &temp) == 1) {
-        buffer = realloc(buffer, (count + 1) * sizeof(int));
-        buffer[count++] = temp;
+        /* recurse into the smaller half, loop on the larger */
+        size_t left = (size_t)j + 1;
+        if (left < n - left) {
+            intro_sort(a, left, depth, flip);
+            a += left;
+            n -= left;
+        } else {
+            intro_sort(a + left, n - left, depth, flip);
+            n = left;
+        }
     }
+    insertion_sort(a, n, flip);
+}
 
-    fclose(fp);
+static int floor_log2(size_t n) {
+    int log = 0;
+    while (n >>= 1)
+        log++;
+    return log;
+}
 
-    free(*data);
-    *data = buffer;
-    *size = count;
+/* One thread's share of a radix pass */
+typedef struct {
+    const int *src;
+    int *dst;
+    size_t lo, hi;
+    int shift;
+    uint32_t flip;
+    size_t count[256];  /* histogram, then scatter positions */
+} RadixSlice;
 
-    printf("Loaded %d values.\n", count);
+static void *radix_histogram(void *arg) {
+    RadixSlice *s = arg;
+    memset(s->count, 0, sizeof(s->count));
+    for (size_t i = s->lo; i < s->hi; i++)
+        s->count[(sort_key(s->src[i], s->flip) >> s->shift) & 255]++;
+    return NULL;
 }
 
-void save_to_file(int *data, int size) {
-    char filename[100];
-    printf("Enter filename to save: ");
-    scanf("%s", filename);
+static void *radix_scatter(void *arg) {
+    RadixSlice *s = arg;
+    for (size_t i = s->lo; i < s->hi; i++) {
+        int value = s->src[i];
+        s->dst[s->count[(sort_key(value, s->flip) >> s->shift) & 255]++] = value;
+    }
+    return NULL;
+}
 
-    FILE *fp = fopen(filename, "w");
-    if (!fp) {
-        printf("Failed to save file.\n");
+static void run_slices(void *(*fn)(void *), RadixSlice *slices, int count) {
+    run_parallel(fn, slices, sizeof(RadixSlice), count);
+}
+
+/*
+ * Stable LSD radix sort of `data` through the scratch buffer `tmp`.
+ * Each slice counts its own digits, the counts are turned into
+ * per-slice output positions (all of slice 0's 0x00 keys, then slice
+ * 1's, ...), and every slice scatters independently.
+ */
+static void radix_sort(int *data, int *tmp, size_t n, uint32_t flip, int threads) {
+    RadixSlice *slices = malloc((size_t)threads * sizeof(RadixSlice));
+    if (!slices) {
+        intro_sort(data, n, 2 * floor_log2(n), flip);
+        return;
+    }
+
+    int *src = data, *dst = tmp;
+    for (int shift = 0; shift < 32; shift += 8) {
+        for (int t = 0; t < threads; t++) {
+            slices[t].src = src;
+            slices[t].dst = dst;
+            slices[t].lo = n * (size_t)t / (size_t)threads;
+            slices[t].hi = n * (size_t)(t + 1) / (size_t)threads;
+            slices[t].shift = shift;
+            slices[t].flip = flip;
+        }
+        run_slices(radix_histogram, slices, threads);
+
+        size_t pos = 0;
+        int skip = 0;
+        for (int b = 0; b < 256 && !skip; b++) {
+            size_t total = 0;
+            for (int t = 0; t < threads; t++) {
+                size_t c = slices[t].count[b];
+                slices[t].count[b] = pos + total;
+                total += c;
+            }
+            skip = (total == n);  /* every key has this byte: nothing to move */
+            pos += total;
+        }
+        if (skip)
+            continue;
+
+        run_slices(radix_scatter, slices, threads);
+        int *swap = src;
+        src = dst;
+        dst = swap;
+    }
+
+    if (src != data)
+        memcpy(data, src, n * sizeof(int));
+    free(slices);
+}
+
+void sort_dataset(int *data, size_t n, int flags) {
+    uint32_t flip = (flags & SORT_DESCENDING) ? 0x7fffffffu : 0x80000000u;
+
+    if (n < RADIX_SORT_MIN) {
+        intro_sort(data, n, 2 * floor_log2(n), flip);
+        return;
+    }
+
+    int *tmp = malloc(n * sizeof(int));
+    if (!tmp) {
+        /* not enough memory for the scratch copy: sort in place */
+        intro_sort(data, n, 2 * floor_log2(n), flip);
         return;
     }
 
-    for (int i = 0; i < size; i++)
-        fprintf(fp, "%d\n", data[i]);
+    int threads = n >= PARALLEL_SORT_MIN ? available_threads() : 1;
+    radix_sort(data, tmp, n, flip, threads);
+    free(tmp);
+}
+
+/* ============================
+   Reduction Kernels
+   ============================ */
+/*
+ * sum, average, min and max all come from a single fused pass. The
+ * widest kernel the CPU supports is picked on first use; every kernel
+ * keeps 64-bit sums, so results match the scalar version exactly.
+ */
+static void describe_scalar(const int *data, size_t n, Summary *out) {
+    long long sum = 0;
+    int min = data[0], max = data[0];
+    for (size_t i = 0; i < n; i++) {
+        int v = data[i];
+        sum += v;
+        if (v < min) min = v;
+        if (v > max) max = v;
+    }
+    out->sum = sum;
+    out->min = min;
+    out->max = max;
+}
+
+#ifdef HAVE_X86_KERNELS
+__attribute__((target("sse4.1")))
+static void describe_sse41(const int *data, size_t n, Summary *out) {
+    __m128i vmin = _mm_set1_epi32(data[0]);
+    __m128i vmax = vmin;
+    __m128i sum0 = _mm_setzero_si128(), sum1 = _mm_setzero_si128();
+    size_t i = 0;
+
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        vmin = _mm_min_epi32(vmin, v);
+        vmax = _mm_max_epi32(vmax, v);
+        sum0 = _mm_add_epi64(sum0, _mm_cvtepi32_epi64(v));
+        sum1 = _mm_add_epi64(sum1, _mm_cvtepi32_epi64(_mm_srli_si128(v, 8)));
+    }
+
+    int32_t mins[4], maxs[4];
+    int64_t sums[2];
+    _mm_storeu_si128((__m128i *)mins, vmin);
+    _mm_storeu_si128((__m128i *)maxs, vmax);
+    _mm_storeu_si128((__m128i *)sums, _mm_add_epi64(sum0, sum1));
+
+    long long sum = sums[0] + sums[1];
+    int min = mins[0], max = maxs[0];
+    for (int k = 1; k < 4; k++) {
+        if (mins[k] < min) min = mins[k];
+        if (maxs[k] > max) max = maxs[k];
+    }
+    for (; i < n; i++) {
+        sum += data[i];
+        if (data[i] < min) min = data[i];
+        if (data[i] > max) max = data[i];
+    }
+    out->sum = sum;
+    out->min = min;
+    out->max = max;
+}
+
+__attribute__((target("avx2")))
+static void describe_avx2(const int *data, size_t n, Summary *out) {
+    __m256i vmin = _mm256_set1_epi32(data[0]);
+    __m256i vmax = vmin;
+    __m256i sum0 = _mm256_setzero_si256(), sum1 = _mm256_setzero_si256();
+    size_t i = 0;
+
+    /* two independent vectors per iteration to hide load latency */
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(data + i + 8));
+        vmin = _mm256_min_epi32(vmin, _mm256_min_epi32(a, b));
+        vmax = _mm256_max_epi32(vmax, _mm256_max_epi32(a, b));
+        sum0 = _mm256_add_epi64(sum0, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(a)));
+        sum1 = _mm256_add_epi64(sum1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(a, 1)));
+        sum0 = _mm256_add_epi64(sum0, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(b)));
+        sum1 = _mm256_add_epi64(sum1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(b, 1)));
+    }
+
+    int32_t mins[8], maxs[8];
+    int64_t sums[4];
+    _mm256_storeu_si256((__m256i *)mins, vmin);
+    _mm256_storeu_si256((__m256i *)maxs, vmax);
+    _mm256_storeu_si256((__m256i *)sums, _mm256_add_epi64(sum0, sum1));
+
+    long long sum = sums[0] + sums[1] + sums[2] + sums[3];
+    int min = mins[0], max = maxs[0];
+    for (int k = 1; k < 8; k++) {
+        if (mins[k] < min) min = mins[k];
+        if (maxs[k] > max) max = maxs[k];
+    }
+    for (; i < n; i++) {
+        sum += data[i];
+        if (data[i] < min) min = data[i];
+        if (data[i] > max) max = data[i];
+    }
+    out->sum = sum;
+    out->min = min;
+    out->max = max;
+}
+#endif
+
+static describe_func describe_kernel = NULL;
+static const char *describe_kernel_label = "scalar";
+
+static void select_describe_kernel(void) {
+    describe_kernel = describe_scalar;
+#ifdef HAVE_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        describe_kernel = describe_avx2;
+        describe_kernel_label = "avx2";
+    } else if (__builtin_cpu_supports("sse4.1")) {
+        describe_kernel = describe_sse41;
+        describe_kernel_label = "sse4.1";
+    }
+#endif
+}
+
+const char *describe_kernel_name(void) {
+    if (!describe_kernel)
+        select_describe_kernel();
+    return describe_kernel_label;
+}
+
+/* Fills `out` for n > 0 values */
+void describe_dataset(const int *data, size_t n, Summary *out) {
+    if (!describe_kernel)
+        select_describe_kernel();
+    describe_kernel(data, n, out);
+    out->count = n;
+    out->mean = (double)out->sum / (double)n;
+}
+
+/* ============================
+   Typed Kernels
+   ============================ */
+/*
+ * Datasets hold int32, int64, float or double values. Every kernel is
+ * written once as a macro and stamped out per type, so each element
+ * loop is compiled for exactly one type; an operation looks its type
+ * up in type_kernels[] once and then runs straight through.
+ *
+ * int32 only takes the per-element helpers from the macros. Its bulk
+ * kernels are the specialised ones above (SIMD describe, threaded
+ * radix sort) and the SWAR text loader.
+ */
+
+/* Order-preserving unsigned keys, as sort_key() does for int32 */
+static inline uint64_t key_int64(int64_t v) {
+    return (uint64_t)v ^ 0x8000000000000000ULL;
+}
+
+static inline uint32_t key_float(float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return (bits >> 31) ? ~bits : bits | 0x80000000u;
+}
+
+static inline uint64_t key_double(double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    return (bits >> 63) ? ~bits : bits | 0x8000000000000000ULL;
+}
+
+/* Parse one value at `p`; false if there is none or it is out of range */
+static inline int scan_int32(const char *p, char **end, TypedValue *out) {
+    errno = 0;
+    long long v = strtoll(p, end, 10);
+    out->i32 = (int32_t)v;
+    return *end != p && errno == 0 && v >= INT32_MIN && v <= INT32_MAX;
+}
+
+static inline int scan_int64(const char *p, char **end, TypedValue *out) {
+    errno = 0;
+    out->i64 = strtoll(p, end, 10);
+    return *end != p && errno == 0;
+}
+
+static inline int scan_float(const char *p, char **end, TypedValue *out) {
+    out->f32 = strtof(p, end);
+    return *end != p;
+}
+
+static inline int scan_double(const char *p, char **end, TypedValue *out) {
+    out->f64 = strtod(p, end);
+    return *end != p;
+}
+
+/* Reads a whole file into a NUL-terminated buffer */
+static int read_text_file(const char *filename, char **out) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp)
+        return -1;
 
+    char *text = NULL;
+    long len = -1;
+    if (fseek(fp, 0, SEEK_END) == 0 && (len = ftell(fp)) >= 0 && fseek(fp, 0, SEEK_SET) == 0)
+        text = malloc((size_t)len + 1);
+    if (!text || fread(text, 1, (size_t)len, fp) != (size_t)len) {
+        free(text);
+        fclose(fp);
+        return -1;
+    }
     fclose(fp);
-    printf("Saved %d values.\n", size);
+    text[len] = '\0';
+    *out = text;
+    return 0;
+}
+
+/* Single-value helpers: T is the C type, M its TypedValue member */
+#define DEFINE_ELEMENT_KERNELS(T, NAME, M, PT, FMT)                                  \
+static size_t find_##NAME(const void *data, size_t n, const TypedValue *value,       \
+                          size_t *first) {                                           \
+    const T *a = data;                                                               \
+    const T v = value->M;                                                            \
+    size_t i = 0, count = 0;                                                         \
+    while (i < n && a[i] != v)                                                       \
+        i++;                                                                         \
+    *first = i;                                                                      \
+    for (; i < n; i++)                                                               \
+        count += a[i] == v;                                                          \
+    return count;                                                                    \
+}                                                                                    \
+                                                                                     \
+static double get_##NAME(const void *data, size_t i) {                               \
+    return (double)((const T *)data)[i];                                             \
+}                                                                                    \
+                                                                                     \
+static int parse_##NAME(const char *text, TypedValue *out) {                         \
+    char *end;                                                                       \
+    return scan_##NAME(text, &end, out) && *end == '\0' ? 0 : -1;                    \
+}                                                                                    \
+                                                                                     \
+static int format_##NAME(const void *data, size_t i, char *buf, size_t len) {        \
+    return snprintf(buf, len, FMT, (PT)((const T *)data)[i]);                        \
+}
+
+/*
+ * Whole-array kernels. K is the unsigned key type and KEY maps a value
+ * to a key with the same order; ACC accumulates sums. The sort is an
+ * LSD radix sort over key bytes (bytes every key shares are skipped),
+ * with heapsort for short arrays or when scratch memory runs out.
+ */
+#define DEFINE_BULK_KERNELS(T, NAME, M, K, KEY, ACC, PT, SAVE_FMT)                   \
+static void describe_##NAME(const void *data, size_t n, TypedSummary *out) {         \
+    const T *a = data;                                                               \
+    ACC sum = 0;                                                                     \
+    T min = a[0], max = a[0];                                                        \
+    for (size_t i = 0; i < n; i++) {                                                 \
+        sum += a[i];                                                                 \
+        min = a[i] < min ? a[i] : min;                                               \
+        max = a[i] > max ? a[i] : max;                                               \
+    }                                                                                \
+    out->count = n;                                                                  \
+    out->sum = (long double)sum;                                                     \
+    out->mean = (double)(out->sum / (long double)n);                                 \
+    out->min.M = min;                                                                \
+    out->max.M = max;                                                                \
+}                                                                                    \
+                                                                                     \
+static void sift_##NAME(T *a, size_t root, size_t n, K flip) {                       \
+    T value = a[root];                                                               \
+    K key = KEY(value) ^ flip;                                                       \
+    for (;;) {                                                                       \
+        size_t child = 2 * root + 1;                                                 \
+        if (child >= n)                                                              \
+            break;                                                                   \
+        if (child + 1 < n && (KEY(a[child + 1]) ^ flip) > (KEY(a[child]) ^ flip))    \
+            child++;                                                                 \
+        if ((KEY(a[child]) ^ flip) <= key)                                           \
+            break;                                                                   \
+        a[root] = a[child];                                                          \
+        root = child;                                                                \
+    }                                                                                \
+    a[root] = value;                                                                 \
+}                                                                                    \
+                                                                                     \
+static void sort_##NAME(void *data, size_t n, int flags) {                           \
+    T *a = data;                                                                     \
+    const K flip = (flags & SORT_DESCENDING) ? (K)~(K)0 : 0;                         \
+    T *tmp = n >= RADIX_SORT_MIN ? malloc(n * sizeof(T)) : NULL;                     \
+    if (!tmp) {                                                                      \
+        for (size_t i = n / 2; i-- > 0; )                                            \
+            sift_##NAME(a, i, n, flip);                                              \
+        for (size_t end = n; end-- > 1; ) {                                          \
+            T top = a[0];                                                            \
+            a[0] = a[end];                                                           \
+            a[end] = top;                                                            \
+            sift_##NAME(a, 0, end, flip);                                            \
+        }                                                                            \
+        return;                                                                      \
+    }                                                                                \
+                                                                                     \
+    /* one pass counts every digit of every key */                                   \
+    size_t count[sizeof(K)][256];                                                    \
+    memset(count, 0, sizeof(count));                                                 \
+    for (size_t i = 0; i < n; i++) {                                                 \
+        K key = KEY(a[i]) ^ flip;                                                    \
+        for (size_t d = 0; d < sizeof(K); d++)                                       \
+            count[d][(key >> (8 * d)) & 0xff]++;                                     \
+    }                                                                                \
+                                                                                     \
+    T *src = a, *dst = tmp;                                                          \
+    for (size_t d = 0; d < sizeof(K); d++) {                                         \
+        if (count[d][((KEY(a[0]) ^ flip) >> (8 * d)) & 0xff] == n)                   \
+            continue;                                                                \
+        size_t pos = 0;                                                              \
+        for (int b = 0; b < 256; b++) {                                              \
+            size_t c = count[d][b];                                                  \
+            count[d][b] = pos;                                                       \
+            pos += c;                                                                \
+        }                                                                            \
+        for (size_t i = 0; i < n; i++) {                                             \
+            K key = KEY(src[i]) ^ flip;                                              \
+            dst[count[d][(key >> (8 * d)) & 0xff]++] = src[i];                       \
+        }                                                                            \
+        T *swap = src;                                                               \
+        src = dst;                                                                   \
+        dst = swap;                                                                  \
+    }                                                                                \
+    if (src != a)                                                                    \
+        memcpy(a, src, n * sizeof(T));                                               \
+    free(tmp);                                                                       \
+}                                                                                    \
+                                                                                     \
+/* Stops at the first token that is not a value, as fscanf would */                 \
+static int load_text_##NAME(const char *filename, void **out, size_t *count) {       \
+    char *text;                                                                      \
+    if (read_text_file(filename, &text) != 0)                                        \
+        return -1;                                                                   \
+                                                                                     \
+    T *values = NULL;                                                                \
+    size_t n = 0, capacity = 0;                                                      \
+    const char *p = text;                                                            \
+    TypedValue v;                                                                    \
+    char *end;                                                                       \
+    while (scan_##NAME(p, &end, &v)) {                                               \
+        if (n == capacity) {                                                         \
+            capacity = capacity ? capacity * 2 : 1024;                               \
+            T *grown = realloc(values, capacity * sizeof(T));                        \
+            if (!grown) {                                                            \
+                free(values);                                                        \
+                free(text);                                                          \
+                return -1;                                                           \
+            }                                                                        \
+            values = grown;                                                          \
+        }                                                                            \
+        values[n++] = v.M;                                                           \
+        p = end;                                                                     \
+    }                                                                                \
+    free(text);                                                                      \
+    *out = values;                                                                   \
+    *count = n;                                                                      \
+    return 0;                                                                        \
+}                                                                                    \
+                                                                                     \
+static int write_text_##NAME(FILE *fp, const void *data, size_t n) {                 \
+    const T *a = data;                                                               \
+    for (size_t i = 0; i < n; i++)                                                   \
+        if (fprintf(fp, SAVE_FMT "\n", (PT)a[i]) < 0)                                \
+            return -1;                                                               \
+    return 0;                                                                        \
+}
+
+DEFINE_ELEMENT_KERNELS(int32_t, int32,  i32, long long, "%lld")
+DEFINE_ELEMENT_KERNELS(int64_t, int64,  i64, long long, "%lld")
+DEFINE_ELEMENT_KERNELS(float,   float,  f32, double,    "%g")
+DEFINE_ELEMENT_KERNELS(double,  double, f64, double,    "%.10g")
+
+DEFINE_BULK_KERNELS(int64_t, int64,  i64, uint64_t, key_int64,  __int128, long long, "%lld")
+DEFINE_BULK_KERNELS(float,   float,  f32, uint32_t, key_float,  double,   double,    "%.9g")
+DEFINE_BULK_KERNELS(double,  double, f64, uint64_t, key_double, double,   double,    "%.17g")
+
+/* int32 bulk kernels wrap the specialised engine */
+static void describe_int32(const void *data, size_t n, TypedSummary *out) {
+    Summary s;
+    describe_dataset(data, n, &s);
+    out->count = s.count;
+    out->sum = s.sum;
+    out->mean = s.mean;
+    out->min.i32 = s.min;
+    out->max.i32 = s.max;
+}
+
+static void sort_int32(void *data, size_t n, int flags) {
+    sort_dataset(data, n, flags);
+}
+
+static int load_text_int32(const char *filename, void **out, size_t *count) {
+    int *values;
+    if (load_text_dataset(filename, &values, count) != 0)
+        return -1;
+    *out = values;
+    return 0;
+}
+
+static int write_text_int32(FILE *fp, const void *data, size_t n) {
+    return text_write_values(fp, data, n);
+}
+
+#define TYPE_KERNELS(NAME, WIDTH, INTEGER) \
+    { #NAME, WIDTH, INTEGER, describe_##NAME, sort_##NAME, find_##NAME, get_##NAME, \
+      parse_##NAME, format_##NAME, load_text_##NAME, write_text_##NAME }
+
+static const TypeKernels type_kernels[TYPE_COUNT] = {
+    [TYPE_INT32]  = TYPE_KERNELS(int32, 4, 1),
+    [TYPE_INT64]  = TYPE_KERNELS(int64, 8, 1),
+    [TYPE_FLOAT]  = TYPE_KERNELS(float, 4, 0),
+    [TYPE_DOUBLE] = TYPE_KERNELS(double, 8, 0)
+};
+
+const TypeKernels *kernels_for(const Dataset *ds) {
+    return &type_kernels[ds->type];
+}
+
+/* Asks for a value type; returns -1 on a bad answer */
+int read_value_type(ValueType *type) {
+    int choice;
+    printf("Value type (1=int32, 2=int64, 3=float, 4=double): ");
+    if (scanf("%d", &choice) != 1 || choice < 1 || choice > TYPE_COUNT)
+        return -1;
+    *type = (ValueType)(choice - 1);
+    return 0;
+}
+
+/* Reads one value of the dataset's type from the user */
+int read_typed_value(const Dataset *ds, TypedValue *value) {
+    char text[64];
+    if (scanf("%63s", text) != 1)
+        return -1;
+    return kernels_for(ds)->parse(text, value);
+}
+
+/* ============================
+   Search Index
+   ============================ */
+/*
+ * Lives in the Dataset, is built on the first query after a change and
+ * is dropped by dataset_changed(), which every edit, load and sort goes
+ * through, so a mostly static dataset pays for it once.
+ *
+ * Point lookups go through an open-addressing hash (linear probing,
+ * power-of-two table, at most 70% full) mapping each distinct value to
+ * its first index and occurrence count. Lower-bound and range queries
+ * use the sorted values in Eytzinger (BFS) order: the top levels of the
+ * implicit search tree share a few cache lines, and each step can
+ * prefetch the descendants four levels down.
+ */
+#define INDEX_BATCH_GROUP 16   /* lookups whose slots are prefetched together */
+
+void index_invalidate(SearchIndex *ix) {
+    free(ix->slots);
+    free(ix->tree);
+    free(ix->rank);
+    memset(ix, 0, sizeof(*ix));
+}
+
+static inline size_t index_hash(int key, size_t mask) {
+    return (size_t)(((uint32_t)key * 0x9E3779B97F4A7C15ULL) >> 17) & mask;
+}
+
+/* In-order walk of the implicit tree, filling it from the sorted array */
+static size_t eytzinger_fill(SearchIndex *ix, const int *sorted, size_t i, size_t k) {
+    if (k <= ix->n) {
+        i = eytzinger_fill(ix, sorted, i, 2 * k);
+        ix->tree[k] = sorted[i];
+        ix->rank[k] = i++;
+        i = eytzinger_fill(ix, sorted, i, 2 * k + 1);
+    }
+    return i;
+}
+
+static int index_build(Dataset *ds) {
+    SearchIndex *ix = &ds->index;
+    const int *data = ds->values;
+    size_t n = ds->size;
+    if (ix->valid)
+        return 0;
+    index_invalidate(ix);
+
+    int *sorted = malloc(n * sizeof(int));
+    ix->tree = malloc((n + 1) * sizeof(int));
+    ix->rank = malloc((n + 1) * sizeof(size_t));
+    if (!sorted || !ix->tree || !ix->rank) {
+        free(sorted);
+        index_invalidate(ix);
+        return -1;
+    }
+
+    memcpy(sorted, data, n * sizeof(int));
+    sort_dataset(sorted, n, 0);
+
+    size_t distinct = n > 0;
+    for (size_t i = 1; i < n; i++)
+        distinct += sorted[i] != sorted[i - 1];
+
+    ix->n = n;
+    eytzinger_fill(ix, sorted, 0, 1);
+    free(sorted);
+
+    size_t cap = 16;
+    while (cap * 7 < distinct * 10)
+        cap *= 2;
+    ix->slots = calloc(cap, sizeof(IndexSlot));
+    if (!ix->slots) {
+        index_invalidate(ix);
+        return -1;
+    }
+    ix->mask = cap - 1;
+
+    /* insert in index order so each slot keeps the first position;
+       slots are prefetched a group ahead, as in index_lookup_batch() */
+    for (size_t base = 0; base < n; base += INDEX_BATCH_GROUP) {
+        size_t hashes[INDEX_BATCH_GROUP];
+        size_t group = n - base < INDEX_BATCH_GROUP ? n - base : INDEX_BATCH_GROUP;
+        for (size_t g = 0; g < group; g++) {
+            hashes[g] = index_hash(data[base + g], ix->mask);
+            __builtin_prefetch(&ix->slots[hashes[g]], 1);
+        }
+        for (size_t g = 0; g < group; g++) {
+            size_t i = base + g, h = hashes[g];
+            while (ix->slots[h].count && ix->slots[h].key != data[i])
+                h = (h + 1) & ix->mask;
+            if (ix->slots[h].count++ == 0) {
+                ix->slots[h].key = data[i];
+                ix->slots[h].first = i;
+            }
+        }
+    }
+
+    ix->valid = 1;
+    return 0;
+}
+
+static inline const IndexSlot *index_probe(const SearchIndex *ix, int value, size_t h) {
+    while (ix->slots[h].count) {
+        if (ix->slots[h].key == value)
+            return &ix->slots[h];
+        h = (h + 1) & ix->mask;
+    }
+    return NULL;
+}
+
+/* First index and count of `value`; returns -1 if absent */
+int index_lookup(Dataset *ds, int value, size_t *first, size_t *count) {
+    if (index_build(ds) != 0) {
+        /* no memory for an index: fall back to a scan */
+        size_t hits = 0;
+        for (size_t i = ds->size; i-- > 0; )
+            if (ds->values[i] == value) {
+                *first = i;
+                hits++;
+            }
+        *count = hits;
+        return hits ? 0 : -1;
+    }
+
+    const IndexSlot *slot = index_probe(&ds->index, value, index_hash(value, ds->index.mask));
+    if (!slot)
+        return -1;
+    *first = slot->first;
+    *count = (size_t)slot->count;
+    return 0;
+}
+
+/*
+ * Looks up many values at once. Queries are hashed and their slots
+ * prefetched a group at a time, so the cache misses of a whole group
+ * overlap instead of being paid one after another. Returns the number
+ * found; first[i] is -1 for a miss.
+ */
+size_t index_lookup_batch(Dataset *ds, const int *queries, size_t q, long long *first) {
+    if (index_build(ds) != 0) {
+        size_t hits = 0;
+        for (size_t i = 0; i < q; i++) {
+            size_t at, count;
+            first[i] = index_lookup(ds, queries[i], &at, &count) == 0 ? (long long)at : -1;
+            hits += first[i] >= 0;
+        }
+        return hits;
+    }
+
+    const SearchIndex *ix = &ds->index;
+    size_t hashes[INDEX_BATCH_GROUP];
+    size_t hits = 0;
+
+    for (size_t base = 0; base < q; base += INDEX_BATCH_GROUP) {
+        size_t group = q - base < INDEX_BATCH_GROUP ? q - base : INDEX_BATCH_GROUP;
+        for (size_t g = 0; g < group; g++) {
+            hashes[g] = index_hash(queries[base + g], ix->mask);
+            __builtin_prefetch(&ix->slots[hashes[g]]);
+        }
+        for (size_t g = 0; g < group; g++) {
+            const IndexSlot *slot = index_probe(ix, queries[base + g], hashes[g]);
+            first[base + g] = slot ? (long long)slot->first : -1;
+            hits += slot != NULL;
+        }
+    }
+    return hits;
+}
+
+/*
+ * Smallest value >= `value` and its rank among the sorted values
+ * (rank == n and nothing stored in *found when every value is smaller).
+ * Returns -1 only if the index cannot be built.
+ */
+int index_lower_bound(Dataset *ds, int value, int *found, size_t *rank) {
+    if (index_build(ds) != 0)
+        return -1;
+
+    const SearchIndex *ix = &ds->index;
+    size_t k = 1;
+    while (k <= ix->n) {
+        __builtin_prefetch(ix->tree + 16 * k);
+        k = 2 * k + (ix->tree[k] < value);
+    }
+    /* undo the final run of right turns plus one left turn */
+    k >>= __builtin_ffsll(~(long long)k);
+
+    if (k == 0) {
+        *rank = ix->n;
+        return 0;
+    }
+    *found = ix->tree[k];
+    *rank = ix->rank[k];
+    return 0;
+}
+
+/* ============================
+   Running Statistics
+   ============================ */
+/*
+ * Sum, min and max are computed once and then adjusted by each edit, so
+ * repeated queries on a live dataset are O(1). Deleting the last copy
+ * of an extreme marks them stale, and the next query rescans.
+ *
+ * Order statistics come from one of two structures, both built on the
+ * first query and skipped by edits until then:
+ *   exact        a sorted copy of the values. Edits binary-search their
+ *                slot and shift the tail; quantiles are an array read.
+ *   approximate  a KLL sketch of a few KB. Appends feed it; any delete
+ *                or modify drops it, since a sketch cannot forget.
+ */
+static size_t count_equal(const int *values, size_t n, int value) {
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++)
+        count += values[i] == value;
+    return count;
+}
+
+static void running_add(RunningStats *rs, const int *values, size_t n) {
+    if (!rs->valid || n == 0)
+        return;
+
+    Summary part;
+    describe_dataset(values, n, &part);
+    rs->sum += part.sum;
+    if (rs->stale)
+        return;
+    if (part.min < rs->min) {
+        rs->min = part.min;
+        rs->minCount = count_equal(values, n, part.min);
+    } else if (part.min == rs->min) {
+        rs->minCount += count_equal(values, n, part.min);
+    }
+    if (part.max > rs->max) {
+        rs->max = part.max;
+        rs->maxCount = count_equal(values, n, part.max);
+    } else if (part.max == rs->max) {
+        rs->maxCount += count_equal(values, n, part.max);
+    }
+}
+
+static void running_remove(RunningStats *rs, int value) {
+    if (!rs->valid)
+        return;
+    rs->sum -= value;
+    if (value == rs->min && --rs->minCount == 0)
+        rs->stale = 1;
+    if (value == rs->max && --rs->maxCount == 0)
+        rs->stale = 1;
+}
+
+static void running_refresh(Dataset *ds) {
+    RunningStats *rs = &ds->stats;
+    if (ds->size == 0) {
+        rs->valid = 0;
+        return;
+    }
+    if (rs->valid && !rs->stale)
+        return;
+
+    Summary s;
+    describe_dataset(ds->values, ds->size, &s);
+    rs->sum = s.sum;
+    rs->min = s.min;
+    rs->max = s.max;
+    rs->minCount = rs->maxCount = 0;
+    for (size_t i = 0; i < ds->size; i++) {
+        rs->minCount += ds->values[i] == s.min;
+        rs->maxCount += ds->values[i] == s.max;
+    }
+    rs->valid = 1;
+    rs->stale = 0;
+}
+
+/* Summary in the dataset's own type: kept current for int32, one kernel pass otherwise */
+void dataset_typed_summary(Dataset *ds, TypedSummary *out) {
+    if (ds->type != TYPE_INT32) {
+        kernels_for(ds)->describe(ds->data, ds->size, out);
+        return;
+    }
+    Summary s;
+    dataset_summary(ds, &s);
+    out->count = s.count;
+    out->sum = s.sum;
+    out->mean = s.mean;
+    out->min.i32 = s.min;
+    out->max.i32 = s.max;
+}
+
+void dataset_summary(Dataset *ds, Summary *out) {
+    running_refresh(ds);
+    out->count = ds->size;
+    out->sum = ds->stats.sum;
+    out->mean = ds->size ? (double)ds->stats.sum / (double)ds->size : 0.0;
+    out->min = ds->stats.min;
+    out->max = ds->stats.max;
+}
+
+//   Sorted copy (exact mode)
+
+/* First position whose value is > `value` (or >= when `strict` is 0) */
+static size_t sorted_bound(const int *a, size_t n, int value, int strict) {
+    size_t lo = 0, hi = n;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (a[mid] < value || (strict && a[mid] == value))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void order_drop(OrderStats *o) {
+    free(o->sorted);
+    o->sorted = NULL;
+    o->size = o->capacity = 0;
+    o->valid = 0;
+}
+
+static int order_grow(OrderStats *o, size_t n) {
+    if (n <= o->capacity)
+        return 0;
+    size_t cap = o->capacity ? o->capacity : DATASET_MIN_CAPACITY;
+    while (cap < n)
+        cap *= 2;
+    int *sorted = realloc(o->sorted, cap * sizeof(int));
+    if (!sorted) {
+        order_drop(o);     /* rebuilt by the next query */
+        return -1;
+    }
+    o->sorted = sorted;
+    o->capacity = cap;
+    return 0;
+}
+
+static int order_build(Dataset *ds) {
+    OrderStats *o = &ds->order;
+    if (o->valid)
+        return 0;
+    if (order_grow(o, ds->size) != 0)
+        return -1;
+    memcpy(o->sorted, ds->values, ds->size * sizeof(int));
+    sort_dataset(o->sorted, ds->size, 0);
+    o->size = ds->size;
+    o->valid = 1;
+    return 0;
+}
+
+/* Sorts the new values apart, then merges them in from the back */
+static void order_insert(OrderStats *o, const int *values, size_t n) {
+    if (!o->valid || n == 0 || order_grow(o, o->size + n) != 0)
+        return;
+
+    if (n == 1) {
+        size_t pos = sorted_bound(o->sorted, o->size, values[0], 1);
+        memmove(o->sorted + pos + 1, o->sorted + pos, (o->size - pos) * sizeof(int));
+        o->sorted[pos] = values[0];
+        o->size++;
+        return;
+    }
+
+    int *added = malloc(n * sizeof(int));
+    if (!added) {
+        order_drop(o);
+        return;
+    }
+    memcpy(added, values, n * sizeof(int));
+    sort_dataset(added, n, 0);
+
+    size_t i = o->size, j = n, out = o->size + n;
+    while (j > 0) {
+        if (i > 0 && o->sorted[i - 1] > added[j - 1])
+            o->sorted[--out] = o->sorted[--i];
+        else
+            o->sorted[--out] = added[--j];
+    }
+    o->size += n;
+    free(added);
+}
+
+static void order_remove(OrderStats *o, int value) {
+    if (!o->valid)
+        return;
+    size_t pos = sorted_bound(o->sorted, o->size, value, 0);
+    memmove(o->sorted + pos, o->sorted + pos + 1, (o->size - pos - 1) * sizeof(int));
+    o->size--;
+}
+
+/* Moves one value to its new slot, shifting only the values between */
+static void order_replace(OrderStats *o, int old, int value) {
+    if (!o->valid || old == value)
+        return;
+    size_t from = sorted_bound(o->sorted, o->size, old, 0);
+    if (value > old) {
+        size_t to = sorted_bound(o->sorted, o->size, value, 0) - 1;
+        memmove(o->sorted + from, o->sorted + from + 1, (to - from) * sizeof(int));
+        o->sorted[to] = value;
+    } else {
+        size_t to = sorted_bound(o->sorted, o->size, value, 1);
+        memmove(o->sorted + to + 1, o->sorted + to, (from - to) * sizeof(int));
+        o->sorted[to] = value;
+    }
+}
+
+/* Removes a batch of values (in any order) in one merge pass */
+static void order_remove_batch(OrderStats *o, int *removed, size_t k) {
+    if (!o->valid)
+        return;
+    sort_dataset(removed, k, 0);
+    size_t j = 0, out = 0;
+    for (size_t i = 0; i < o->size; i++) {
+        if (j < k && o->sorted[i] == removed[j])
+            j++;
+        else
+            o->sorted[out++] = o->sorted[i];
+    }
+    o->size = out;
+}
+
+static void order_delete_if(OrderStats *o, value_predicate pred, const void *ctx) {
+    if (!o->valid)
+        return;
+    size_t out = 0;
+    for (size_t i = 0; i < o->size; i++) {
+        o->sorted[out] = o->sorted[i];
+        out += !pred(o->sorted[i], ctx);
+    }
+    o->size = out;
+}
+
+//   KLL sketch (approximate mode)
+
+static void sketch_free(QuantileSketch *sk) {
+    for (int h = 0; h < SKETCH_MAX_LEVELS; h++)
+        free(sk->level[h]);
+    free(sk->view);
+    memset(sk, 0, sizeof(*sk));
+}
+
+/* Lower levels get geometrically less room (factor 2/3 per level) */
+static uint32_t sketch_capacity(const QuantileSketch *sk, int h) {
+    double cap = SKETCH_K;
+    for (int d = sk->levels - 1 - h; d > 0 && cap > 8; d--)
+        cap *= 2.0 / 3.0;
+    return cap > 8 ? (uint32_t)cap : 8;
+}
+
+static void sketch_add_level(QuantileSketch *sk) {
+    sk->levels++;
+    sk->limit = 0;
+    for (int h = 0; h < sk->levels; h++)
+        sk->limit += sketch_capacity(sk, h);
+}
+
+static int sketch_push(QuantileSketch *sk, int h, int value) {
+    if (sk->size[h] == sk->room[h]) {
+        uint32_t room = sk->room[h] ? sk->room[h] * 2 : 16;
+        int *items = realloc(sk->level[h], room * sizeof(int));
+        if (!items)
+            return -1;
+        sk->level[h] = items;
+        sk->room[h] = room;
+    }
+    sk->level[h][sk->size[h]++] = value;
+    sk->items++;
+    return 0;
+}
+
+/* Keeps every other item of a sorted level, at twice the weight */
+static int sketch_compact(QuantileSketch *sk, int h) {
+    if (h + 1 == sk->levels) {
+        if (sk->levels == SKETCH_MAX_LEVELS)
+            return -1;
+        sketch_add_level(sk);
+    }
+
+    int *items = sk->level[h];
+    uint32_t pairs = sk->size[h] & ~1u;
+    sort_dataset(items, sk->size[h], 0);
+
+    sk->rng ^= sk->rng << 13;
+    sk->rng ^= sk->rng >> 7;
+    sk->rng ^= sk->rng << 17;
+    for (uint32_t i = (uint32_t)(sk->rng & 1); i < pairs; i += 2)
+        if (sketch_push(sk, h + 1, items[i]) != 0)
+            return -1;
+
+    items[0] = items[sk->size[h] - 1];   /* odd one out stays behind */
+    sk->items -= pairs;
+    sk->size[h] -= pairs;
+    return 0;
+}
+
+static int sketch_update(QuantileSketch *sk, int value) {
+    if (sketch_push(sk, 0, value) != 0)
+        return -1;
+    sk->n++;
+    sk->viewValid = 0;
+    if (sk->items < sk->limit)
+        return 0;
+    for (int h = 0; h < sk->levels; h++)
+        if (sk->size[h] >= sketch_capacity(sk, h))
+            return sketch_compact(sk, h);
+    return 0;
+}
+
+static void sketch_insert(QuantileSketch *sk, const int *values, size_t n) {
+    if (!sk->valid)
+        return;
+    for (size_t i = 0; i < n; i++)
+        if (sketch_update(sk, values[i]) != 0) {
+            sketch_free(sk);
+            return;
+        }
+}
+
+static int sketch_build(Dataset *ds) {
+    QuantileSketch *sk = &ds->order.sketch;
+    if (sk->valid)
+        return 0;
+    sketch_free(sk);
+    sk->rng = 0x9e3779b97f4a7c15ULL;
+    sketch_add_level(sk);
+    sk->valid = 1;
+    sketch_insert(sk, ds->values, ds->size);
+    return sk->valid ? 0 : -1;
+}
+
+static int compare_sketch_items(const void *a, const void *b) {
+    int x = ((const SketchItem *)a)->value, y = ((const SketchItem *)b)->value;
+    return (x > y) - (x < y);
+}
+
+static int sketch_quantile(QuantileSketch *sk, double q, int *out) {
+    if (!sk->viewValid) {
+        free(sk->view);
+        sk->view = malloc((sk->items ? sk->items : 1) * sizeof(SketchItem));
+        if (!sk->view)
+            return -1;
+        size_t k = 0;
+        for (int h = 0; h < sk->levels; h++)
+            for (uint32_t i = 0; i < sk->size[h]; i++) {
+                sk->view[k].value = sk->level[h][i];
+                sk->view[k++].rank = 1ULL << h;
+            }
+        qsort(sk->view, k, sizeof(SketchItem), compare_sketch_items);
+        for (size_t i = 1; i < k; i++)
+            sk->view[i].rank += sk->view[i - 1].rank;
+        sk->viewCount = k;
+        sk->viewValid = 1;
+    }
+
+    /* first item whose cumulative weight passes the target rank */
+    uint64_t target = (uint64_t)(q * (double)(sk->n - 1));
+    size_t lo = 0, hi = sk->viewCount - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (sk->view[mid].rank <= target)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    *out = sk->view[lo].value;
+    return 0;
+}
+
+//   Hooks for the container, and queries
+
+static void stats_inserted(Dataset *ds, const void *values, size_t n) {
+    if (ds->type != TYPE_INT32)
+        return;
+    running_add(&ds->stats, values, n);
+    order_insert(&ds->order, values, n);
+    sketch_insert(&ds->order.sketch, values, n);
+}
+
+static void stats_removed(Dataset *ds, int value) {
+    running_remove(&ds->stats, value);
+    order_remove(&ds->order, value);
+    if (ds->order.sketch.valid)
+        sketch_free(&ds->order.sketch);
+}
+
+static void stats_replaced(Dataset *ds, int old, int value) {
+    running_remove(&ds->stats, old);
+    running_add(&ds->stats, &value, 1);
+    order_replace(&ds->order, old, value);
+    if (ds->order.sketch.valid)
+        sketch_free(&ds->order.sketch);
+}
+
+static void stats_reset(Dataset *ds) {
+    memset(&ds->stats, 0, sizeof(ds->stats));
+    order_drop(&ds->order);
+    sketch_free(&ds->order.sketch);
+}
+
+/* Frees whichever structure the new mode no longer uses */
+void dataset_order_mode(Dataset *ds, int approximate) {
+    ds->order.approximate = approximate;
+    if (approximate)
+        order_drop(&ds->order);
+    else
+        sketch_free(&ds->order.sketch);
+}
+
+/* A sorted copy of a non-int32 dataset, made per query */
+static void *typed_sorted_copy(const Dataset *ds, int flags) {
+    const TypeKernels *k = kernels_for(ds);
+    void *copy = malloc(ds->size * k->width);
+    if (copy) {
+        memcpy(copy, ds->data, ds->size * k->width);
+        k->sort(copy, ds->size, flags);
+    }
+    return copy;
+}
+
+/* q in [0, 1]; exact mode interpolates between the two nearest ranks */
+int dataset_quantile(Dataset *ds, double q, double *out) {
+    if (ds->size == 0)
+        return -1;
+
+    double pos = q * (double)(ds->size - 1);
+    size_t lo = (size_t)pos;
+    size_t hi = lo + 1 < ds->size ? lo + 1 : lo;
+
+    if (ds->type != TYPE_INT32) {
+        const TypeKernels *k = kernels_for(ds);
+        void *sorted = typed_sorted_copy(ds, 0);
+        if (!sorted)
+            return -1;
+        double a = k->get(sorted, lo), b = k->get(sorted, hi);
+        *out = a + (pos - (double)lo) * (b - a);
+        free(sorted);
+        return 0;
+    }
+
+    if (ds->order.approximate) {
+        int value;
+        if (sketch_build(ds) != 0 || sketch_quantile(&ds->order.sketch, q, &value) != 0)
+            return -1;
+        *out = value;
+        return 0;
+    }
+
+    if (order_build(ds) != 0)
+        return -1;
+    const int *a = ds->order.sorted;
+    *out = a[lo] + (pos - (double)lo) * ((double)a[hi] - (double)a[lo]);
+    return 0;
+}
+
+/*
+ * Writes the k largest values (of the dataset's type), largest first.
+ * Exact mode reads them off the sorted copy; approximate mode, which
+ * keeps no copy, streams the data through a k-entry min-heap instead
+ * (the answer is still exact). Other types sort a copy.
+ */
+size_t dataset_top_k(Dataset *ds, size_t k, void *result) {
+    if (k > ds->size)
+        k = ds->size;
+
+    if (ds->type != TYPE_INT32) {
+        void *sorted = typed_sorted_copy(ds, SORT_DESCENDING);
+        if (!sorted)
+            return 0;
+        memcpy(result, sorted, k * kernels_for(ds)->width);
+        free(sorted);
+        return k;
+    }
+
+    int *out = result;
+    if (!ds->order.approximate && order_build(ds) == 0) {
+        for (size_t i = 0; i < k; i++)
+            out[i] = ds->order.sorted[ds->size - 1 - i];
+        return k;
+    }
+
+    const uint32_t minHeap = 0x7fffffffu;   /* descending keys: root is the smallest */
+    memcpy(out, ds->values, k * sizeof(int));
+    for (size_t i = k / 2; i-- > 0; )
+        sift_down(out, i, k, minHeap);
+    for (size_t i = k; i < ds->size; i++) {
+        if (ds->values[i] > out[0]) {
+            out[0] = ds->values[i];
+            sift_down(out, 0, k, minHeap);
+        }
+    }
+    sort_dataset(out, k, SORT_DESCENDING);
+    return k;
+}
+
+/* ============================
+   Dataset Container
+   ============================ */
+/*
+ * Values live in one array that doubles when full and halves once it
+ * is a quarter used, so appends are amortised O(1) and a run of deletes
+ * does not hold on to memory. Deletes are batched: every removal in a
+ * call is done by a single compaction pass over the array.
+ */
+
+/* The int32-only helpers below are noted; the rest take any type. */
+
+/* The values still live in the column file's mapping */
+static int dataset_mapped(const Dataset *ds) {
+    return ds->column.base && ds->data == (const void *)(ds->column.base + COLUMN_DATA_OFFSET);
+}
+
+/* Every change to the values or their order goes through here */
+void dataset_changed(Dataset *ds) {
+    if (ds->index.valid)
+        index_invalidate(&ds->index);
+    ds->columnCurrent = 0;
+    if (ds->column.base && !dataset_mapped(ds))
+        column_close(&ds->column);
+}
+
+/*
+ * Closes the column file the values came from, first copying them to
+ * a heap array of at least `capacity` values if they are still mapped.
+ */
+int dataset_detach(Dataset *ds, size_t capacity) {
+    if (dataset_mapped(ds)) {
+        size_t width = kernels_for(ds)->width;
+        if (capacity < ds->size)
+            capacity = ds->size;
+        void *data = malloc((capacity ? capacity : 1) * width);
+        if (!data)
+            return -1;
+        memcpy(data, ds->data, ds->size * width);
+        ds->data = data;
+        ds->capacity = capacity;
+    }
+    column_close(&ds->column);
+    ds->columnCurrent = 0;
+    return 0;
+}
+
+/* Frees the values, or unmaps them with their column file */
+static void dataset_release(Dataset *ds) {
+    if (!dataset_mapped(ds))
+        free(ds->data);
+    ds->data = NULL;
+    column_close(&ds->column);
+    ds->columnCurrent = 0;
+}
+
+int dataset_reserve(Dataset *ds, size_t capacity) {
+    if (capacity <= ds->capacity)
+        return 0;
+    size_t cap = ds->capacity ? ds->capacity : DATASET_MIN_CAPACITY;
+    while (cap < capacity)
+        cap *= 2;
+    if (dataset_mapped(ds))
+        return dataset_detach(ds, cap);
+    void *data = realloc(ds->data, cap * kernels_for(ds)->width);
+    if (!data)
+        return -1;
+    ds->data = data;
+    ds->capacity = cap;
+    return 0;
+}
+
+/* int32 datasets */
+int dataset_append(Dataset *ds, int value) {
+    if (ds->size == ds->capacity && dataset_reserve(ds, ds->size + 1) != 0)
+        return -1;
+    ds->values[ds->size++] = value;
+    stats_inserted(ds, &value, 1);
+    dataset_changed(ds);
+    return 0;
+}
+
+/* `values` are of the dataset's type */
+int dataset_append_bulk(Dataset *ds, const void *values, size_t n) {
+    size_t width = kernels_for(ds)->width;
+    if (dataset_reserve(ds, ds->size + n) != 0)
+        return -1;
+    memcpy((char *)ds->data + ds->size * width, values, n * width);
+    ds->size += n;
+    stats_inserted(ds, values, n);
+    dataset_changed(ds);
+    return 0;
+}
+
+/* int32 datasets */
+void dataset_set(Dataset *ds, size_t i, int value) {
+    stats_replaced(ds, ds->values[i], value);
+    ds->values[i] = value;
+    dataset_changed(ds);
+}
+
+void dataset_store(Dataset *ds, size_t i, const TypedValue *value) {
+    if (ds->type == TYPE_INT32) {
+        dataset_set(ds, i, value->i32);
+        return;
+    }
+    size_t width = kernels_for(ds)->width;
+    memcpy((char *)ds->data + i * width, value, width);
+    dataset_changed(ds);
+}
+
+/* Replaces the contents with a malloc'd array of `type`, taking ownership of it */
+void dataset_adopt(Dataset *ds, ValueType type, void *values, size_t n) {
+    dataset_release(ds);
+    ds->type = type;
+    ds->data = values;
+    ds->size = n;
+    ds->capacity = n;
+    stats_reset(ds);
+    dataset_changed(ds);
+}
+
+static void dataset_shrink(Dataset *ds) {
+    if (ds->capacity <= DATASET_MIN_CAPACITY || ds->size > ds->capacity / 4 || dataset_mapped(ds))
+        return;
+    size_t cap = ds->capacity / 2;
+    while (cap > DATASET_MIN_CAPACITY && ds->size <= cap / 4)
+        cap /= 2;
+    void *data = realloc(ds->data, cap * kernels_for(ds)->width);
+    if (data) {
+        ds->data = data;
+        ds->capacity = cap;
+    }
+}
+
+/*
+ * Deletes every listed index (any order, duplicates and out-of-range
+ * entries ignored) in one pass. Returns the number removed, or 0 if
+ * the marking bitmap cannot be allocated.
+ */
+size_t dataset_delete_indices(Dataset *ds, const size_t *indices, size_t k) {
+    if (k == 0 || ds->size == 0)
+        return 0;
+
+    if (k == 1) {
+        /* a single delete only needs the tail moved down */
+        size_t at = indices[0];
+        if (at >= ds->size)
+            return 0;
+        size_t width = kernels_for(ds)->width;
+        char *bytes = ds->data;
+        if (ds->type == TYPE_INT32)
+            stats_removed(ds, ds->values[at]);
+        memmove(bytes + at * width, bytes + (at + 1) * width, (ds->size - at - 1) * width);
+        ds->size--;
+        dataset_changed(ds);
+        dataset_shrink(ds);
+        return 1;
+    }
+
+    uint64_t *doomed = calloc((ds->size + 63) / 64, sizeof(uint64_t));
+    if (!doomed)
+        return 0;
+    size_t first = ds->size;
+    for (size_t i = 0; i < k; i++) {
+        if (indices[i] < ds->size) {
+            doomed[indices[i] / 64] |= 1ULL << (indices[i] % 64);
+            if (indices[i] < first)
+                first = indices[i];
+        }
+    }
+
+    /* the sorted copy, if any, drops the same values in one merge */
+    int *gone = NULL;
+    size_t goneCount = 0;
+    if (ds->order.valid && !(gone = malloc(k * sizeof(int))))
+        order_drop(&ds->order);
+
+    size_t out = first;
+    if (ds->type == TYPE_INT32) {
+        for (size_t i = first; i < ds->size; i++) {
+            int value = ds->values[i];
+            int drop = doomed[i / 64] >> (i % 64) & 1;
+            ds->values[out] = value;
+            out += !drop;
+            if (drop) {
+                running_remove(&ds->stats, value);
+                if (gone)
+                    gone[goneCount++] = value;
+            }
+        }
+    } else if (kernels_for(ds)->width == 4) {
+        /* other types only move bits: compact by width */
+        uint32_t *words = ds->data;
+        for (size_t i = first; i < ds->size; i++) {
+            words[out] = words[i];
+            out += !(doomed[i / 64] >> (i % 64) & 1);
+        }
+    } else {
+        uint64_t *words = ds->data;
+        for (size_t i = first; i < ds->size; i++) {
+            words[out] = words[i];
+            out += !(doomed[i / 64] >> (i % 64) & 1);
+        }
+    }
+    free(doomed);
+    if (gone) {
+        order_remove_batch(&ds->order, gone, goneCount);
+        free(gone);
+    }
+
+    size_t removed = ds->size - out;
+    ds->size = out;
+    if (removed) {
+        sketch_free(&ds->order.sketch);
+        dataset_changed(ds);
+        dataset_shrink(ds);
+    }
+    return removed;
+}
+
+/* Deletes every value for which `pred` is true, in one pass (int32 datasets) */
+size_t dataset_delete_if(Dataset *ds, value_predicate pred, const void *ctx) {
+    size_t out = 0;
+    for (size_t i = 0; i < ds->size; i++) {
+        int value = ds->values[i];
+        int drop = pred(value, ctx);
+        ds->values[out] = value;
+        out += !drop;
+        if (drop)
+            running_remove(&ds->stats, value);
+    }
+
+    size_t removed = ds->size - out;
+    ds->size = out;
+    if (removed) {
+        order_delete_if(&ds->order, pred, ctx);
+        sketch_free(&ds->order.sketch);
+        dataset_changed(ds);
+        dataset_shrink(ds);
+    }
+    return removed;
+}
+
+void dataset_free(Dataset *ds) {
+    index_invalidate(&ds->index);
+    stats_reset(ds);
+    dataset_release(ds);
+    memset(ds, 0, sizeof(*ds));
+}
+
+/* Parses ">0", "> 0", "<=-5", "==7", "!=3". Returns -1 if malformed. */
+int parse_condition(const char *text, Condition *cond) {
+    static const struct { const char *op; Comparison cmp; } ops[] = {
+        { "<=", CMP_LE }, { ">=", CMP_GE }, { "==", CMP_EQ }, { "!=", CMP_NE },
+        { "<", CMP_LT }, { ">", CMP_GT }, { "=", CMP_EQ }
+    };
+
+    while (*text == ' ' || *text == '\t')
+        text++;
+    for (size_t k = 0; k < sizeof(ops) / sizeof(ops[0]); k++) {
+        size_t len = strlen(ops[k].op);
+        if (strncmp(text, ops[k].op, len) == 0) {
+            char *end;
+            cond->cmp = ops[k].cmp;
+            cond->operand = strtoll(text + len, &end, 10);
+            return end == text + len ? -1 : 0;
+        }
+    }
+    return -1;
+}
+
+int condition_matches(int value, const void *ctx) {
+    const Condition *c = ctx;
+    switch (c->cmp) {
+        case CMP_LT: return value < c->operand;
+        case CMP_LE: return value <= c->operand;
+        case CMP_GT: return value > c->operand;
+        case CMP_GE: return value >= c->operand;
+        case CMP_EQ: return value == c->operand;
+        default:     return value != c->operand;
+    }
+}
+
+//   Dataset Editing
+
+void add_value(Dataset *ds) {
+    TypedValue new_val;
+    printf("Enter value to add: ");
+    if (read_typed_value(ds, &new_val) != 0) {
+        printf("Invalid value.\n");
+        return;
+    }
+
+    if (dataset_append_bulk(ds, &new_val, 1) != 0) {
+        printf("Not enough memory.\n");
+        return;
+    }
+
+    printf("Value added.\n");
+}
+
+void modify_value(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    long long index;
+    TypedValue new_val;
+
+    printf("Enter index to modify (0-%zu): ", ds->size - 1);
+    scanf("%lld", &index);
+
+    if (index < 0 || (size_t)index >= ds->size) {
+        printf("Invalid index.\n");
+        return;
+    }
+
+    printf("Enter new value: ");
+    if (read_typed_value(ds, &new_val) != 0) {
+        printf("Invalid value.\n");
+        return;
+    }
+    dataset_store(ds, (size_t)index, &new_val);
+
+    printf("Value updated.\n");
+}
+
+/* Accepts one index, or several separated by spaces and ended by -1 */
+void delete_value(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+
+    printf("Enter index to delete (0-%zu), or several ending with -1: ", ds->size - 1);
+
+    size_t *indices = NULL, count = 0, capacity = 0;
+    long long index;
+    int invalid = 0;
+    while (scanf("%lld", &index) == 1 && index != -1) {
+        if (index < 0 || (size_t)index >= ds->size) {
+            invalid = 1;
+        } else {
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                size_t *grown = realloc(indices, capacity * sizeof(size_t));
+                if (!grown) {
+                    free(indices);
+                    printf("Not enough memory.\n");
+                    return;
+                }
+                indices = grown;
+            }
+            indices[count++] = (size_t)index;
+        }
+
+        /* a lone index on its line is a single delete */
+        int c = getchar();
+        if (c == '\n' && count + invalid == 1)
+            break;
+        ungetc(c, stdin);
+    }
+
+    if (invalid) {
+        printf("Invalid index.\n");
+        free(indices);
+        return;
+    }
+
+    size_t removed = dataset_delete_indices(ds, indices, count);
+    free(indices);
+    if (removed == 1)
+        printf("Value deleted.\n");
+    else
+        printf("%zu values deleted.\n", removed);
+}
+
+void delete_matching(Dataset *ds) {
+    if (ds->size == 0) { printf("Dataset empty.\n"); return; }
+    if (needs_int32(ds) != 0)
+        return;
+
+    char text[64];
+    Condition cond;
+    printf("Delete values matching (e.g. >0, <=-5, ==7): ");
+    scanf("%63s", text);
+    if (parse_condition(text, &cond) != 0) {
+        printf("Invalid condition.\n");
+        return;
+    }
+
+    size_t removed = dataset_delete_if(ds, condition_matches, &cond);
+    printf("%zu values deleted.\n", removed);
+}
+
+void new_dataset(Dataset *ds) {
+    ValueType type;
+    if (read_value_type(&type) != 0) {
+        printf("Invalid value type.\n");
+        return;
+    }
+    dataset_free(ds);
+    ds->type = type;
+    printf("Started an empty %s dataset.\n", kernels_for(ds)->name);
+}
+
+/* ============================
+   File I/O
+   ============================ */
+
+/*
+ * Text files are memory-mapped and parsed in place. Large files are cut
+ * into one chunk per thread at whitespace boundaries, so no number is
+ * ever split, and each chunk parses into its own geometrically growing
+ * buffer. Like the old fscanf loop, loading stops at the first token
+ * that is not an int; values before it are kept.
+ */
+typedef struct {
+    const char *begin;
+    const char *end;
+    int *values;
+    size_t count;
+    size_t capacity;
+    int stopped;        /* hit something that is not an int */
+    int failed;         /* out of memory */
+} ParseChunk;
+
+static inline int is_space(char c) {
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static int chunk_push(ParseChunk *c, int value) {
+    if (c->count == c->capacity) {
+        size_t cap = c->capacity ? c->capacity * 2 : 1024;
+        int *values = realloc(c->values, cap * sizeof(int));
+        if (!values)
+            return -1;
+        c->values = values;
+        c->capacity = cap;
+    }
+    c->values[c->count++] = value;
+    return 0;
+}
+
+/*
+ * Reads up to eight leading digits of `p` at once (SWAR): subtract '0'
+ * from every byte, find the first byte that is not 0..9, and fold the
+ * digits pairwise with three multiplies. Returns the digits consumed.
+ * Borrows from the subtraction only reach bytes after the first
+ * non-digit, which are shifted out before folding.
+ */
+static inline int parse_digits8(const char *p, uint64_t *value) {
+    uint64_t chunk;
+    memcpy(&chunk, p, 8);
+
+    uint64_t d = chunk - 0x3030303030303030ULL;
+    uint64_t nondigit = ((d + 0x7676767676767676ULL) | d) & 0x8080808080808080ULL;
+    int len = nondigit ? __builtin_ctzll(nondigit) / 8 : 8;
+    if (len == 0)
+        return 0;
+
+    /* the first digit sits in the low byte: left-align so the gap reads as leading zeros */
+    d <<= 8 * (8 - len);
+    d = (d * 10 + (d >> 8)) & 0x00ff00ff00ff00ffULL;
+    d = (((d & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32))) +
+         (((d >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32)))) >> 32;
+    *value = d;
+    return len;
+}
+
+static void *parse_chunk(void *arg) {
+    ParseChunk *c = arg;
+    const char *p = c->begin, *end = c->end;
+
+    /* a short number is at least two bytes with its separator */
+    if (!c->values) {
+        size_t guess = (size_t)(end - p) / 8 + 16;
+        c->values = malloc(guess * sizeof(int));
+        c->capacity = c->values ? guess : 0;
+    }
+
+    for (;;) {
+        while (p < end && is_space(*p))
+            p++;
+        if (p == end)
+            break;
+
+        int negative = (*p == '-');
+        if (*p == '-' || *p == '+')
+            p++;
+        if (p == end || (unsigned)(*p - '0') > 9) {
+            c->stopped = 1;
+            break;
+        }
+
+        /* ten digits always fit in 64 bits; an eleventh means overflow */
+        const char *limit = end - p > 10 ? p + 10 : end;
+        uint64_t v = 0;
+        if (end - p >= 8)
+            p += parse_digits8(p, &v);
+        while (p < limit && (unsigned)(*p - '0') <= 9)
+            v = v * 10 + (unsigned)(*p++ - '0');
+        if ((p < end && (unsigned)(*p - '0') <= 9) || v > (uint64_t)INT_MAX + negative) {
+            c->stopped = 1;
+            break;
+        }
+
+        if (chunk_push(c, negative ? (int)(0 - v) : (int)v) != 0) {
+            c->failed = 1;
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* Loads whitespace-separated ints from `filename` into a new array */
+int load_text_dataset(const char *filename, int **out, size_t *count) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    size_t bytes = (size_t)st.st_size;
+    const char *text = "";
+    if (bytes > 0) {
+        text = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (text == MAP_FAILED) {
+            close(fd);
+            return -1;
+        }
+        madvise((void *)text, bytes, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    int threads = bytes >= PARALLEL_PARSE_MIN ? available_threads() : 1;
+    ParseChunk chunks[MAX_THREADS];
+    memset(chunks, 0, sizeof(chunks));
+
+    const char *begin = text, *end = text + bytes;
+    for (int t = 0; t < threads; t++) {
+        const char *split = t == threads - 1 ? end : text + bytes / (size_t)threads * (size_t)(t + 1);
+        if (split < begin)
+            split = begin;
+        while (split < end && !is_space(*split))
+            split++;
+        chunks[t].begin = begin;
+        chunks[t].end = split;
+        begin = split;
+    }
+
+    run_parallel(parse_chunk, chunks, sizeof(ParseChunk), threads);
+
+    /* keep every chunk up to and including the first one that stopped */
+    size_t total = 0;
+    int used = 0, failed = 0;
+    while (used < threads) {
+        failed |= chunks[used].failed;
+        total += chunks[used].count;
+        if (chunks[used++].stopped)
+            break;
+    }
+
+    int *values = NULL;
+    if (!failed && used == 1) {
+        values = chunks[0].values;   /* single chunk: hand its buffer over */
+        chunks[0].values = NULL;
+    } else if (!failed) {
+        values = malloc((total ? total : 1) * sizeof(int));
+        size_t pos = 0;
+        for (int t = 0; values && t < used; t++) {
+            memcpy(values + pos, chunks[t].values, chunks[t].count * sizeof(int));
+            pos += chunks[t].count;
+        }
+    }
+
+    for (int t = 0; t < threads; t++)
+        free(chunks[t].values);
+    if (bytes > 0)
+        munmap((void *)text, bytes);
+
+    if (failed || (!values && total > 0))
+        return -1;
+
+    *out = values;
+    *count = total;
+    return 0;
+}
+
+/* ============================
+   Binary Column Files
+   ============================ */
+/*
+ * Layout:
+ *
+ *   ColumnHeader            (padded to COLUMN_DATA_OFFSET)
+ *   block 0 .. block N-1    raw int32/int64 values, or delta + varint
+ *   ColumnBlock[N]          offset, size, count, min and max per block
+ *
+ * Raw int32 columns are used straight from the mapping with no parse
+ * step. The per-block min/max footer answers min and max without
+ * reading any values, and lets searches skip every block whose range
+ * cannot hold the value.
+ *
+ * Compressed blocks store each value as the zigzag-encoded difference
+ * from the previous one (the first against 0), written as a varint.
+ * Sorted or slowly changing data shrinks to a byte or two per value.
+ */
+static size_t put_varint(unsigned char *out, uint64_t v) {
+    size_t len = 0;
+    while (v >= 0x80) {
+        out[len++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    out[len++] = (unsigned char)v;
+    return len;
+}
+
+static inline uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/*
+ * Encodes `count` values of `width` bytes into w->buffer and returns the
+ * encoded size. Always inlined with a constant width, so each caller
+ * gets a loop compiled for one value type.
+ */
+static inline __attribute__((always_inline))
+size_t column_encode(ColumnWriter *w, const void *values, size_t count, size_t width,
+                     int64_t *minOut, int64_t *maxOut) {
+    int64_t min = INT64_MAX, max = INT64_MIN;
+    size_t bytes = 0;
+    int64_t previous = 0;
+    for (size_t i = 0; i < count; i++) {
+        int64_t v = width == 8 ? ((const int64_t *)values)[i] : ((const int *)values)[i];
+        if (v < min) min = v;
+        if (v > max) max = v;
+        if (w->compress) {
+            bytes += put_varint(w->buffer + bytes, zigzag((int64_t)((uint64_t)v - (uint64_t)previous)));
+            previous = v;
+        } else if (width == 8) {
+            memcpy(w->buffer + bytes, &v, 8);
+            bytes += 8;
+        } else {
+            int narrow = (int)v;
+            memcpy(w->buffer + bytes, &narrow, 4);
+            bytes += 4;
+        }
+    }
+    *minOut = min;
+    *maxOut = max;
+    return bytes;
+}
+
+/* Encodes one block of `count` values and appends it to the file */
+static int column_flush_block(ColumnWriter *w, const void *values, size_t count) {
+    if (w->blockCount == w->blockCapacity) {
+        size_t cap = w->blockCapacity ? w->blockCapacity * 2 : 64;
+        ColumnBlock *blocks = realloc(w->blocks, cap * sizeof(ColumnBlock));
+        if (!blocks)
+            return -1;
+        w->blocks = blocks;
+        w->blockCapacity = cap;
+    }
+
+    int64_t min, max;
+    size_t bytes = w->type == COLUMN_INT64
+                 ? column_encode(w, values, count, 8, &min, &max)
+                 : column_encode(w, values, count, 4, &min, &max);
+
+    ColumnBlock *blk = &w->blocks[w->blockCount++];
+    blk->offset = w->offset;
+    blk->bytes = (uint32_t)bytes;
+    blk->count = (uint32_t)count;
+    blk->min = min;
+    blk->max = max;
+    w->offset += bytes;
+    w->count += count;
+    return fwrite(w->buffer, 1, bytes, w->fp) == bytes ? 0 : -1;
+}
+
+/* Starts a column file of `type`, compressed if asked */
+int column_writer_open(ColumnWriter *w, const char *filename, uint32_t type, int compress) {
+    static const unsigned char padding[COLUMN_DATA_OFFSET];
+    size_t width = type == COLUMN_INT64 ? 8 : 4;
+
+    memset(w, 0, sizeof(*w));
+    w->type = type;
+    w->compress = compress;
+    w->offset = COLUMN_DATA_OFFSET;
+    w->pending = malloc(COLUMN_BLOCK_VALUES * width);
+    w->buffer = malloc(COLUMN_BLOCK_VALUES * (compress ? 10 : width));
+    w->fp = fopen(filename, "wb");
+
+    /* the header is written last, once the counts are known */
+    if (!w->pending || !w->buffer || !w->fp ||
+        fwrite(padding, 1, COLUMN_DATA_OFFSET, w->fp) != COLUMN_DATA_OFFSET) {
+        if (w->fp)
+            fclose(w->fp);
+        free(w->pending);
+        free(w->buffer);
+        memset(w, 0, sizeof(*w));
+        return -1;
+    }
+    return 0;
+}
+
+/* Appends values of the column's type; full blocks are written straight away */
+int column_writer_append(ColumnWriter *w, const void *values, size_t n) {
+    size_t width = w->type == COLUMN_INT64 ? 8 : 4;
+    const char *next = values;
+
+    while (n > 0) {
+        if (w->pendingCount == 0 && n >= COLUMN_BLOCK_VALUES) {
+            /* whole block available in the caller's buffer: no copy */
+            if (column_flush_block(w, next, COLUMN_BLOCK_VALUES) != 0)
+                return -1;
+            next += COLUMN_BLOCK_VALUES * width;
+            n -= COLUMN_BLOCK_VALUES;
+            continue;
+        }
+
+        size_t take = COLUMN_BLOCK_VALUES - w->pendingCount;
+        if (take > n)
+            take = n;
+        memcpy((char *)w->pending + w->pendingCount * width, next, take * width);
+        w->pendingCount += take;
+        next += take * width;
+        n -= take;
+
+        if (w->pendingCount == COLUMN_BLOCK_VALUES) {
+            if (column_flush_block(w, w->pending, COLUMN_BLOCK_VALUES) != 0)
+                return -1;
+            w->pendingCount = 0;
+        }
+    }
+    return 0;
+}
+
+/* Writes the last partial block, the footer and the header */
+int column_writer_close(ColumnWriter *w) {
+    static const unsigned char padding[8];
+    int ok = 1;
+
+    if (w->pendingCount > 0)
+        ok = column_flush_block(w, w->pending, w->pendingCount) == 0;
+
+    ColumnHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COLUMN_MAGIC, 4);
+    header.version = COLUMN_VERSION;
+    header.type = w->type;
+    header.flags = w->compress ? COLUMN_COMPRESSED : 0;
+    header.count = w->count;
+    header.blockCount = w->blockCount;
+    header.blockValues = COLUMN_BLOCK_VALUES;
+
+    /* keep the footer 8-byte aligned so it can be read in place */
+    size_t pad = (size_t)(-w->offset & 7);
+    if (ok && pad)
+        ok = fwrite(padding, 1, pad, w->fp) == pad;
+    header.blockIndexOffset = w->offset + pad;
+    header.fileBytes = header.blockIndexOffset + w->blockCount * sizeof(ColumnBlock);
+
+    if (ok)
+        ok = fwrite(w->blocks, sizeof(ColumnBlock), w->blockCount, w->fp) == w->blockCount;
+    if (ok)
+        ok = fseek(w->fp, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, w->fp) == 1;
+    if (fclose(w->fp) != 0)
+        ok = 0;
+
+    free(w->blocks);
+    free(w->pending);
+    free(w->buffer);
+    memset(w, 0, sizeof(*w));
+    return ok ? 0 : -1;
+}
+
+/* Writes `n` values (int for COLUMN_INT32, int64_t for COLUMN_INT64), compressed if asked */
+int column_write(const char *filename, const void *data, size_t n, uint32_t type, int compress) {
+    ColumnWriter w;
+    if (column_writer_open(&w, filename, type, compress) != 0)
+        return -1;
+    int rc = column_writer_append(&w, data, n);
+    if (column_writer_close(&w) != 0)
+        rc = -1;
+    return rc;
+}
+
+/* Maps a column file and checks that its blocks lie inside it */
+int column_open(Column *col, const char *filename) {
+    memset(col, 0, sizeof(*col));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < COLUMN_DATA_OFFSET) {
+        close(fd);
+        return -1;
+    }
+
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return -1;
+
+    col->base = base;
+    col->bytes = (size_t)st.st_size;
+    col->header = base;
+
+    const ColumnHeader *h = col->header;
+    int valid = memcmp(h->magic, COLUMN_MAGIC, 4) == 0 &&
+                h->version == COLUMN_VERSION &&
+                (h->type == COLUMN_INT32 || h->type == COLUMN_INT64) &&
+                h->fileBytes == col->bytes &&
+                h->blockIndexOffset % 8 == 0 &&
+                h->blockIndexOffset <= col->bytes &&
+                h->blockCount <= (col->bytes - h->blockIndexOffset) / sizeof(ColumnBlock);
+
+    if (valid) {
+        col->blocks = (const ColumnBlock *)(col->base + h->blockIndexOffset);
+        size_t width = h->type == COLUMN_INT64 ? 8 : 4;
+        uint64_t total = 0;
+        for (uint64_t b = 0; valid && b < h->blockCount; b++) {
+            const ColumnBlock *blk = &col->blocks[b];
+            valid = blk->count <= h->blockValues &&
+                    blk->offset <= h->blockIndexOffset &&
+                    blk->bytes <= h->blockIndexOffset - blk->offset &&
+                    ((h->flags & COLUMN_COMPRESSED) ||
+                     (blk->bytes == blk->count * width &&
+                      blk->offset == COLUMN_DATA_OFFSET + b * h->blockValues * width));
+            total += blk->count;
+        }
+        valid = valid && total == h->count;
+    }
+
+    if (!valid) {
+        column_close(col);
+        return -1;
+    }
+    return 0;
+}
+
+void column_close(Column *col) {
+    if (col->base)
+        munmap((void *)col->base, col->bytes);
+    memset(col, 0, sizeof(*col));
+}
+
+/* The whole column as an array, if it is stored as raw int32 */
+const int *column_values(const Column *col) {
+    if (col->header->type != COLUMN_INT32 || (col->header->flags & COLUMN_COMPRESSED))
+        return NULL;
+    return (const int *)(col->base + COLUMN_DATA_OFFSET);
+}
+
+/*
+ * Decodes one block into `out`, which has room for blockValues values
+ * of `width` bytes. Returns the number of values, or -1 if the block is
+ * corrupt (or, for int output, holds values outside the int range).
+ * Inlined per width like column_encode().
+ */
+static inline __attribute__((always_inline))
+int column_decode(const Column *col, size_t block, void *out, size_t width) {
+    const ColumnHeader *h = col->header;
+    const ColumnBlock *blk = &col->blocks[block];
+    const unsigned char *p = col->base + blk->offset;
+    int *narrow = out;
+    int64_t *wide = out;
+
+    if (width == 4 && (blk->min < INT_MIN || blk->max > INT_MAX))
+        return -1;
+
+    if (!(h->flags & COLUMN_COMPRESSED)) {
+        size_t stored = h->type == COLUMN_INT64 ? 8 : 4;
+        if (stored == width) {
+            memcpy(out, p, (size_t)blk->count * width);
+        } else if (width == 4) {
+            for (uint32_t i = 0; i < blk->count; i++) {
+                int64_t v;
+                memcpy(&v, p + (size_t)i * 8, 8);
+                narrow[i] = (int)v;
+            }
+        } else {
+            for (uint32_t i = 0; i < blk->count; i++) {
+                int v;
+                memcpy(&v, p + (size_t)i * 4, 4);
+                wide[i] = v;
+            }
+        }
+        return (int)blk->count;
+    }
+
+    const unsigned char *end = p + blk->bytes;
+    int64_t value = 0;
+    for (uint32_t i = 0; i < blk->count; i++) {
+        uint64_t v = 0;
+        int shift = 0;
+        for (;;) {
+            if (p == end || shift > 63)
+                return -1;
+            unsigned char byte = *p++;
+            v |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                break;
+            shift += 7;
+        }
+        value = (int64_t)((uint64_t)value + (uint64_t)unzigzag(v));
+        if (value < blk->min || value > blk->max)
+            return -1;
+        if (width == 8)
+            wide[i] = value;
+        else
+            narrow[i] = (int)value;
+    }
+    return (int)blk->count;
+}
+
+int column_read_block(const Column *col, size_t block, int *out) {
+    return column_decode(col, block, out, 4);
+}
+
+int column_read_block64(const Column *col, size_t block, int64_t *out) {
+    return column_decode(col, block, out, 8);
+}
+
+/* Reads all of an open column as values of `width` bytes */
+static int column_read_all(const Column *col, size_t width, void **out) {
+    size_t n = col->header->count;
+    char *values = malloc((n ? n : 1) * width);
+    const int *raw = column_values(col);
+    if (!values)
+        return -1;
+
+    if (raw && width == 4) {
+        memcpy(values, raw, n * sizeof(int));
+    } else {
+        size_t pos = 0;
+        for (size_t b = 0; b < col->header->blockCount; b++) {
+            int got = width == 8 ? column_read_block64(col, b, (int64_t *)(values + pos * 8))
+                                 : column_read_block(col, b, (int *)(values + pos * 4));
+            if (got < 0) {
+                free(values);
+                return -1;
+            }
+            pos += (size_t)got;
+        }
+    }
+    *out = values;
+    return 0;
+}
+
+/* Reads a whole column file into a new int array */
+int column_load(const char *filename, int **out, size_t *count) {
+    Column col;
+    if (column_open(&col, filename) != 0)
+        return -1;
+
+    void *values;
+    int rc = column_read_all(&col, 4, &values);
+    *count = col.header->count;
+    column_close(&col);
+    if (rc == 0)
+        *out = values;
+    return rc;
+}
+
+/* Reads a whole column file as the type it was written with */
+int column_load_typed(const char *filename, ValueType *type, void **out, size_t *count) {
+    Column col;
+    if (column_open(&col, filename) != 0)
+        return -1;
+
+    *type = col.header->type == COLUMN_INT64 ? TYPE_INT64 : TYPE_INT32;
+    int rc = column_read_all(&col, *type == TYPE_INT64 ? 8 : 4, out);
+    *count = col.header->count;
+    column_close(&col);
+    return rc;
+}
+
+/* min and max come from the block footer alone (column must be non-empty) */
+int64_t column_min(const Column *col) {
+    int64_t min = col->blocks[0].min;
+    for (uint64_t b = 1; b < col->header->blockCount; b++)
+        if (col->blocks[b].min < min)
+            min = col->blocks[b].min;
+    return min;
+}
+
+int64_t column_max(const Column *col) {
+    int64_t max = col->blocks[0].max;
+    for (uint64_t b = 1; b < col->header->blockCount; b++)
+        if (col->blocks[b].max > max)
+            max = col->blocks[b].max;
+    return max;
+}
+
+/*
+ * Index of the first `value`, or -1, with the number of occurrences in
+ * *count. Blocks whose range excludes it are skipped unread.
+ */
+long long column_find(const Column *col, int64_t value, size_t *count) {
+    size_t width = col->header->type == COLUMN_INT64 ? 8 : 4;
+    void *buffer = NULL;
+    long long first = -1, index = 0;
+
+    *count = 0;
+    for (uint64_t b = 0; b < col->header->blockCount; b++) {
+        const ColumnBlock *blk = &col->blocks[b];
+        if (value < blk->min || value > blk->max) {
+            index += blk->count;
+            continue;
+        }
+        if (!buffer && !(buffer = malloc(col->header->blockValues * width)))
+            return -1;
+        int got = width == 8 ? column_read_block64(col, b, buffer) : column_read_block(col, b, buffer);
+        if (got < 0)
+            break;
+        for (int i = 0; i < got; i++) {
+            int64_t v = width == 8 ? ((const int64_t *)buffer)[i] : ((const int *)buffer)[i];
+            if (v == value) {
+                if (first < 0)
+                    first = index + i;
+                (*count)++;
+            }
+        }
+        index += got;
+    }
+    free(buffer);
+    return first;
+}
+
+/*
+ * Makes an open column the dataset's contents and takes it over. Raw
+ * columns are used in place through a copy-on-write mapping, so an
+ * edit copies only the pages it touches; compressed ones are decoded.
+ */
+int dataset_adopt_column(Dataset *ds, Column *col) {
+    const ColumnHeader *h = col->header;
+    ValueType type = h->type == COLUMN_INT64 ? TYPE_INT64 : TYPE_INT32;
+    void *values;
+
+    if (!(h->flags & COLUMN_COMPRESSED)) {
+        if (mprotect((void *)col->base, col->bytes, PROT_READ | PROT_WRITE) != 0)
+            return -1;
+        values = (void *)(col->base + COLUMN_DATA_OFFSET);
+    } else if (column_read_all(col, type == TYPE_INT64 ? 8 : 4, &values) != 0) {
+        return -1;
+    }
+
+    dataset_adopt(ds, type, values, h->count);
+    ds->column = *col;
+    ds->columnCurrent = 1;
+    memset(col, 0, sizeof(*col));
+    return 0;
+}
+
+static int has_extension(const char *filename, const char *ext) {
+    size_t len = strlen(filename), extLen = strlen(ext);
+    return len >= extLen && strcmp(filename + len - extLen, ext) == 0;
+}
+
+/* Column files are recognised by their magic, whatever the name */
+static int is_column_file(const char *filename) {
+    char magic[4] = { 0 };
+    FILE *probe = fopen(filename, "rb");
+    if (probe) {
+        if (fread(magic, 1, 4, probe) != 4)
+            magic[0] = 0;
+        fclose(probe);
+    }
+    return memcmp(magic, COLUMN_MAGIC, 4) == 0;
+}
+
+/*
+ * Reads a text or column file. A column file reports its own type in
+ * *type; a text file is parsed as *type, which is asked for first when
+ * `ask` is set.
+ */
+static int load_any(const char *filename, ValueType *type, int ask, void **values, size_t *count) {
+    if (is_column_file(filename))
+        return column_load_typed(filename, type, values, count);
+    if (ask && read_value_type(type) != 0) {
+        printf("Invalid value type.\n");
+        return -1;
+    }
+    return type_kernels[*type].load_text(filename, values, count);
+}
+
+void load_from_file(Dataset *ds) {
+    char filename[100];
+    printf("Enter filename to load: ");
+    scanf("%s", filename);
+
+    if (is_column_file(filename)) {
+        Column col;
+        if (column_open(&col, filename) != 0 || dataset_adopt_column(ds, &col) != 0) {
+            column_close(&col);
+            printf("Failed to open file.\n");
+            return;
+        }
+    } else {
+        ValueType type = TYPE_INT32;
+        void *buffer = NULL;
+        size_t count = 0;
+        if (load_any(filename, &type, 1, &buffer, &count) != 0) {
+            printf("Failed to open file.\n");
+            return;
+        }
+        dataset_adopt(ds, type, buffer, count);
+    }
+    printf("Loaded %zu %s values.\n", ds->size, kernels_for(ds)->name);
+}
+
+void append_from_file(Dataset *ds) {
+    char filename[100];
+    printf("Enter filename to append: ");
+    scanf("%s", filename);
+
+    ValueType type = ds->type;
+    void *buffer = NULL;
+    size_t count = 0;
+    if (load_any(filename, &type, 0, &buffer, &count) != 0) {
+        printf("Failed to open file.\n");
+        return;
+    }
+    if (type != ds->type) {
+        printf("File holds %s values but the dataset is %s.\n",
+               type_kernels[type].name, kernels_for(ds)->name);
+        free(buffer);
+        return;
+    }
+
+    int rc = dataset_append_bulk(ds, buffer, count);
+    free(buffer);
+    if (rc != 0) {
+        printf("Not enough memory.\n");
+        return;
+    }
+    printf("Appended %zu values (%zu in total).\n", count, ds->size);
+}
+
+void save_to_file(Dataset *ds) {
+    char filename[100];
+    printf("Enter filename to save (.bin for a binary column): ");
+    scanf("%s", filename);
+
+    /* the file may be the one the values are still mapped from */
+    if (ds->column.base && dataset_detach(ds, ds->size) != 0) {
+        printf("Not enough memory.\n");
+        return;
+    }
+
+    if (has_extension(filename, ".bin")) {
+        if (ds->type != TYPE_INT32 && ds->type != TYPE_INT64) {
+            printf("Column files hold int32 or int64 values; save %s data as text.\n",
+                   kernels_for(ds)->name);
+            return;
+        }
+
+        char answer[8];
+        printf("Compress blocks? (y/n): ");
+        scanf("%7s", answer);
+
+        int compress = (answer[0] == 'y' || answer[0] == 'Y');
+        uint32_t columnType = ds->type == TYPE_INT64 ? COLUMN_INT64 : COLUMN_INT32;
+        if (column_write(filename, ds->data, ds->size, columnType, compress) != 0) {
+            printf("Failed to save file.\n");
+            return;
+        }
+        printf("Saved %zu values.\n", ds->size);
+        return;
+    }
+
+    FILE *fp = fopen(filename, "w");
+    if (!fp) {
+        printf("Failed to save file.\n");
+        return;
+    }
+
+    int ok = kernels_for(ds)->write_text(fp, ds->data, ds->size) == 0;
+    if (fclose(fp) != 0 || !ok) {
+        printf("Failed to save file.\n");
+        return;
+    }
+    printf("Saved %zu values.\n", ds->size);
+}
+
+/* Writes one value per line, formatting by hand into a large buffer */
+int text_write_values(FILE *fp, const int *values, size_t n) {
+    char buffer[1 << 16];
+    size_t used = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (used > sizeof(buffer) - 16) {
+            if (fwrite(buffer, 1, used, fp) != used)
+                return -1;
+            used = 0;
+        }
+
+        char digits[12];
+        int len = 0;
+        uint32_t v = values[i] < 0 ? 0u - (uint32_t)values[i] : (uint32_t)values[i];
+        do {
+            digits[len++] = (char)('0' + v % 10);
+            v /= 10;
+        } while (v);
+        if (values[i] < 0)
+            buffer[used++] = '-';
+        while (len > 0)
+            buffer[used++] = digits[--len];
+        buffer[used++] = '\n';
+    }
+    return fwrite(buffer, 1, used, fp) == used ? 0 : -1;
+}
+
+/* ============================
+   Batch Pipeline
+   ============================ */
+/*
+ * ./data_engine --pipeline "load data.bin | filter >0 | sort | describe | save out.bin"
+ *
+ * The source streams the file in chunks of at most PIPELINE_CHUNK values
+ * and every stage handles a chunk before the next is read, so a chunk
+ * passes through the whole pipeline while it is still in cache and
+ * memory stays bounded by the chunk size. Only sort has to see
+ * everything: it collects the stream and replays it sorted once the
+ * source is exhausted.
+ *
+ * Adjacent stages are fused where that saves work:
+ *   - a filter followed only by reductions never writes its output;
+ *     matching values are folded into the statistics in the same loop
+ *   - a run of reductions over the same stream shares one describe pass
+ *   - a filter right after load skips column blocks whose min/max
+ *     cannot match, without reading them
+ */
+#define PIPELINE_CHUNK       COLUMN_BLOCK_VALUES
+#define PIPELINE_TEXT_WINDOW (1 << 20)
+#define PIPELINE_MAX_STAGES  16
+
+typedef enum {
+    STAGE_LOAD,
+    STAGE_FILTER,
+    STAGE_SORT,
+    STAGE_DESCRIBE,
+    STAGE_SUM,
+    STAGE_AVERAGE,
+    STAGE_MIN,
+    STAGE_MAX,
+    STAGE_SEARCH,
+    STAGE_SAVE
+} StageKind;
+
+typedef struct {
+    StageKind kind;
+    char file[256];       /* load / save */
+    Comparison cmp;       /* filter */
+    long long operand;    /* filter / search */
+    int descending;       /* sort */
+    int compress;         /* save to a column */
+
+    int fused;            /* filter: statistics folded in, no output */
+
+    Summary stats;        /* reductions */
+    long long position;   /* search: values seen so far */
+    long long found;      /* search: first match, -1 = none */
+
+    Dataset rows;         /* filter output / sort collection */
+
+    FILE *text;           /* save */
+    ColumnWriter column;
+} Stage;
+
+typedef struct {
+    Stage stages[PIPELINE_MAX_STAGES];
+    int count;
+    int failed;
+} Pipeline;
+
+static int is_reduction(StageKind kind) {
+    return kind >= STAGE_DESCRIBE && kind <= STAGE_MAX;
+}
+
+static int range_may_match(Comparison cmp, long long min, long long max, long long operand) {
+    switch (cmp) {
+        case CMP_LT: return min < operand;
+        case CMP_LE: return min <= operand;
+        case CMP_GT: return max > operand;
+        case CMP_GE: return max >= operand;
+        case CMP_EQ: return min <= operand && operand <= max;
+        default:     return !(min == operand && max == operand);
+    }
+}
+
+static void merge_summary(Summary *total, const Summary *part) {
+    if (part->count == 0)
+        return;
+    if (total->count == 0) {
+        total->min = part->min;
+        total->max = part->max;
+    } else {
+        if (part->min < total->min) total->min = part->min;
+        if (part->max > total->max) total->max = part->max;
+    }
+    total->count += part->count;
+    total->sum += part->sum;
+}
+
+/* Fused filter + reduction: one pass, nothing written */
+#define FILTER_SUMMARY(test)                              \
+    for (size_t i = 0; i < n; i++) {                      \
+        int v = values[i];                                \
+        if (!(test)) continue;                            \
+        if (part.count == 0 || v < part.min) part.min = v; \
+        if (part.count == 0 || v > part.max) part.max = v; \
+        part.sum += v;                                    \
+        part.count++;                                     \
+    }
+
+static void filter_summary(const Stage *st, const int *values, size_t n, Summary *out) {
+    Summary part;
+    long long x = st->operand;
+    memset(&part, 0, sizeof(part));
+    switch (st->cmp) {
+        case CMP_LT: FILTER_SUMMARY(v < x); break;
+        case CMP_LE: FILTER_SUMMARY(v <= x); break;
+        case CMP_GT: FILTER_SUMMARY(v > x); break;
+        case CMP_GE: FILTER_SUMMARY(v >= x); break;
+        case CMP_EQ: FILTER_SUMMARY(v == x); break;
+        case CMP_NE: FILTER_SUMMARY(v != x); break;
+    }
+    *out = part;
+}
+
+/* Feeds a chunk to stage `i` and, through it, to the rest of the pipeline */
+static void pipeline_push(Pipeline *pl, int i, const int *values, size_t n) {
+    Summary chunk;
+    int chunkDescribed = 0;
+
+    for (; i < pl->count && n > 0 && !pl->failed; i++) {
+        Stage *st = &pl->stages[i];
+
+        switch (st->kind) {
+            case STAGE_FILTER:
+                if (st->fused) {
+                    /* the remaining stages are reductions: fold and stop */
+                    filter_summary(st, values, n, &chunk);
+                    for (int j = i + 1; j < pl->count; j++)
+                        merge_summary(&pl->stages[j].stats, &chunk);
+                    return;
+                }
+                if (dataset_reserve(&st->rows, n) != 0) {
+                    pl->failed = 1;
+                    return;
+                }
+                {
+                    Condition cond = { st->cmp, st->operand };
+                    size_t kept = 0;
+                    for (size_t k = 0; k < n; k++) {
+                        st->rows.values[kept] = values[k];
+                        kept += condition_matches(values[k], &cond);
+                    }
+                    st->rows.size = kept;
+                }
+                values = st->rows.values;
+                n = st->rows.size;
+                chunkDescribed = 0;
+                break;
+
+            case STAGE_SORT:
+                if (dataset_append_bulk(&st->rows, values, n) != 0) {
+                    pl->failed = 1;
+                    return;
+                }
+                return;   /* replayed by pipeline_finish() */
+
+            case STAGE_DESCRIBE:
+            case STAGE_SUM:
+            case STAGE_AVERAGE:
+            case STAGE_MIN:
+            case STAGE_MAX:
+                if (!chunkDescribed) {
+                    describe_dataset(values, n, &chunk);
+                    chunkDescribed = 1;
+                }
+                merge_summary(&st->stats, &chunk);
+                break;
+
+            case STAGE_SEARCH:
+                if (st->found < 0) {
+                    for (size_t k = 0; k < n; k++) {
+                        if (values[k] == st->operand) {
+                            st->found = st->position + (long long)k;
+                            break;
+                        }
+                    }
+                }
+                st->position += (long long)n;
+                break;
+
+            case STAGE_SAVE:
+                if (st->text ? text_write_values(st->text, values, n) != 0
+                             : column_writer_append(&st->column, values, n) != 0)
+                    pl->failed = 1;
+                break;
+
+            case STAGE_LOAD:
+                break;
+        }
+    }
+}
+
+/* Streams a text file through the pipeline, one window at a time */
+static int pipeline_load_text(Pipeline *pl, const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    size_t bytes = (size_t)st.st_size;
+    if (bytes == 0) {
+        close(fd);
+        return 0;
+    }
+
+    const char *text = mmap(NULL, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (text == MAP_FAILED)
+        return -1;
+    madvise((void *)text, bytes, MADV_SEQUENTIAL);
+
+    ParseChunk chunk;
+    memset(&chunk, 0, sizeof(chunk));
+
+    const char *begin = text, *end = text + bytes;
+    size_t dropped = 0;
+    while (begin < end && !pl->failed) {
+        const char *split = end - begin > PIPELINE_TEXT_WINDOW ? begin + PIPELINE_TEXT_WINDOW : end;
+        while (split < end && !is_space(*split))
+            split++;
+
+        chunk.begin = begin;
+        chunk.end = split;
+        chunk.count = 0;
+        parse_chunk(&chunk);
+        if (chunk.failed) {
+            pl->failed = 1;
+            break;
+        }
+
+        for (size_t k = 0; k < chunk.count; k += PIPELINE_CHUNK) {
+            size_t n = chunk.count - k < PIPELINE_CHUNK ? chunk.count - k : PIPELINE_CHUNK;
+            pipeline_push(pl, 1, chunk.values + k, n);
+        }
+
+        /* release the text already parsed so resident memory stays bounded */
+        size_t done = (size_t)(split - text) & ~(size_t)4095;
+        if (done > dropped) {
+            madvise((void *)(text + dropped), done - dropped, MADV_DONTNEED);
+            dropped = done;
+        }
+        if (chunk.stopped)
+            break;
+        begin = split;
+    }
+
+    free(chunk.values);
+    munmap((void *)text, bytes);
+    return 0;
+}
+
+/* Streams a column file: raw int32 blocks are passed straight from the mapping */
+static int pipeline_load_column(Pipeline *pl, const char *filename) {
+    Column col;
+    if (column_open(&col, filename) != 0)
+        return -1;
+
+    const Stage *next = pl->count > 1 ? &pl->stages[1] : NULL;
+    const int *raw = column_values(&col);
+    int *buffer = raw ? NULL : malloc(col.header->blockValues * sizeof(int));
+    int rc = (raw || buffer) ? 0 : -1;
+    size_t pos = 0, dropped = 0;
+
+    for (uint64_t b = 0; rc == 0 && b < col.header->blockCount && !pl->failed; b++) {
+        const ColumnBlock *blk = &col.blocks[b];
+        size_t start = pos;
+        pos += blk->count;
+
+        if (next && next->kind == STAGE_FILTER &&
+            !range_may_match(next->cmp, blk->min, blk->max, next->operand))
+            continue;
+
+        if (raw) {
+            pipeline_push(pl, 1, raw + start, blk->count);
+
+            /* as for text, drop mapped pages once they have been streamed */
+            size_t done = (size_t)((const unsigned char *)(raw + pos) - col.base) & ~(size_t)4095;
+            if (done > dropped) {
+                madvise((void *)(col.base + dropped), done - dropped, MADV_DONTNEED);
+                dropped = done;
+            }
+        } else {
+            int got = column_read_block(&col, b, buffer);
+            if (got < 0)
+                rc = -1;
+            else
+                pipeline_push(pl, 1, buffer, (size_t)got);
+        }
+    }
+
+    free(buffer);
+    column_close(&col);
+    return rc;
+}
+
+/* Replays sorted collections downstream, then closes the outputs */
+static void pipeline_finish(Pipeline *pl) {
+    for (int i = 0; i < pl->count; i++) {
+        Stage *st = &pl->stages[i];
+        if (st->kind == STAGE_SORT && !pl->failed) {
+            Dataset *rows = &st->rows;
+            sort_dataset(rows->values, rows->size, st->descending ? SORT_DESCENDING : 0);
+            for (size_t k = 0; k < rows->size; k += PIPELINE_CHUNK) {
+                size_t n = rows->size - k < PIPELINE_CHUNK ? rows->size - k : PIPELINE_CHUNK;
+                pipeline_push(pl, i + 1, rows->values + k, n);
+            }
+            dataset_free(rows);
+        }
+    }
+
+    for (int i = 0; i < pl->count; i++) {
+        Stage *st = &pl->stages[i];
+        if (st->kind == STAGE_SAVE) {
+            int bad = st->text ? fclose(st->text) != 0 : column_writer_close(&st->column) != 0;
+            if (bad) {
+                printf("Failed to save file.\n");
+                pl->failed = 1;
+            }
+        }
+        dataset_free(&st->rows);
+    }
+}
+
+static void print_stage_result(const Stage *st) {
+    const Summary *s = &st->stats;
+    if (st->kind == STAGE_SEARCH) {
+        if (st->found >= 0)
+            printf("Value %lld found at index %lld.\n", st->operand, st->found);
+        else
+            printf("Value not found.\n");
+        return;
+    }
+    if (!is_reduction(st->kind))
+        return;
+    if (s->count == 0) {
+        printf("Dataset empty.\n");
+        return;
+    }
+
+    switch (st->kind) {
+        case STAGE_SUM:
+            printf("Sum = %lld\n", s->sum);
+            break;
+        case STAGE_AVERAGE:
+            printf("Average = %.2f\n", (double)s->sum / (double)s->count);
+            break;
+        case STAGE_MIN:
+            printf("Minimum value = %d\n", s->min);
+            break;
+        case STAGE_MAX:
+            printf("Maximum value = %d\n", s->max);
+            break;
+        default:
+            printf("Count   = %zu\n", s->count);
+            printf("Sum     = %lld\n", s->sum);
+            printf("Mean    = %.2f\n", (double)s->sum / (double)s->count);
+            printf("Minimum = %d\n", s->min);
+            printf("Maximum = %d\n", s->max);
+    }
+}
+
+/* Parses one "name args" stage. Returns -1 with a message on error. */
+static int parse_stage(Stage *st, char *text) {
+    char name[16], arg[256], extra[16];
+    arg[0] = extra[0] = 0;
+    int fields = sscanf(text, "%15s %255s %15s", name, arg, extra);
+    if (fields < 1) {
+        printf("Pipeline error: empty stage.\n");
+        return -1;
+    }
+
+    memset(st, 0, sizeof(*st));
+    st->found = -1;
+
+    if (strcmp(name, "load") == 0 || strcmp(name, "save") == 0) {
+        if (fields < 2) {
+            printf("Pipeline error: %s needs a file name.\n", name);
+            return -1;
+        }
+        st->kind = name[0] == 'l' ? STAGE_LOAD : STAGE_SAVE;
+        snprintf(st->file, sizeof(st->file), "%s", arg);
+        st->compress = strcmp(extra, "compress") == 0;
+    } else if (strcmp(name, "filter") == 0) {
+        /* accepts ">0", "> 0" and ">= -5" */
+        Condition cond;
+        if (parse_condition(strstr(text, "filter") + 6, &cond) != 0) {
+            printf("Pipeline error: filter needs a comparison like >0.\n");
+            return -1;
+        }
+        st->cmp = cond.cmp;
+        st->operand = cond.operand;
+        st->kind = STAGE_FILTER;
+    } else if (strcmp(name, "sort") == 0) {
+        st->kind = STAGE_SORT;
+        st->descending = strcmp(arg, "desc") == 0;
+    } else if (strcmp(name, "search") == 0) {
+        char *endp;
+        st->operand = strtoll(arg, &endp, 10);
+        if (fields < 2 || *endp) {
+            printf("Pipeline error: search needs a value.\n");
+            return -1;
+        }
+        st->kind = STAGE_SEARCH;
+    } else if (strcmp(name, "describe") == 0) {
+        st->kind = STAGE_DESCRIBE;
+    } else if (strcmp(name, "sum") == 0) {
+        st->kind = STAGE_SUM;
+    } else if (strcmp(name, "average") == 0 || strcmp(name, "avg") == 0) {
+        st->kind = STAGE_AVERAGE;
+    } else if (strcmp(name, "min") == 0) {
+        st->kind = STAGE_MIN;
+    } else if (strcmp(name, "max") == 0) {
+        st->kind = STAGE_MAX;
+    } else {
+        printf("Pipeline error: unknown stage '%s'.\n", name);
+        return -1;
+    }
+    return 0;
+}
+
+/* Runs a pipeline spec such as "load a.txt | filter >0 | describe" */
+int run_pipeline(const char *spec) {
+    Pipeline pl;
+    memset(&pl, 0, sizeof(pl));
+
+    char *copy = strdup(spec);
+    if (!copy)
+        return 1;
+    for (char *save, *part = strtok_r(copy, "|", &save); part; part = strtok_r(NULL, "|", &save)) {
+        if (pl.count == PIPELINE_MAX_STAGES) {
+            printf("Pipeline error: more than %d stages.\n", PIPELINE_MAX_STAGES);
+            free(copy);
+            return 1;
+        }
+        if (parse_stage(&pl.stages[pl.count], part) != 0) {
+            free(copy);
+            return 1;
+        }
+        if ((pl.stages[pl.count].kind == STAGE_LOAD) != (pl.count == 0)) {
+            printf("Pipeline error: it must start with exactly one load.\n");
+            free(copy);
+            return 1;
+        }
+        pl.count++;
+    }
+    free(copy);
+    if (pl.count == 0) {
+        printf("Pipeline error: it must start with exactly one load.\n");
+        return 1;
+    }
+
+    /* plan fusions */
+    for (int i = 1; i < pl.count; i++) {
+        Stage *st = &pl.stages[i];
+        if (st->kind == STAGE_FILTER) {
+            st->fused = i + 1 < pl.count;
+            for (int j = i + 1; j < pl.count; j++)
+                st->fused &= is_reduction(pl.stages[j].kind);
+        }
+    }
+
+    /* open outputs before reading anything */
+    for (int i = 1; i < pl.count; i++) {
+        Stage *st = &pl.stages[i];
+        if (st->kind != STAGE_SAVE)
+            continue;
+        int rc = has_extension(st->file, ".bin")
+               ? column_writer_open(&st->column, st->file, COLUMN_INT32, st->compress)
+               : ((st->text = fopen(st->file, "w")) ? 0 : -1);
+        if (rc != 0) {
+            printf("Failed to save file.\n");
+            pl.failed = 1;
+            pl.count = i;   /* only close what was opened */
+            pipeline_finish(&pl);
+            return 1;
+        }
+    }
+
+    char magic[4] = { 0 };
+    FILE *probe = fopen(pl.stages[0].file, "rb");
+    if (probe) {
+        if (fread(magic, 1, 4, probe) != 4)
+            magic[0] = 0;
+        fclose(probe);
+    }
+
+    int rc = memcmp(magic, COLUMN_MAGIC, 4) == 0
+           ? pipeline_load_column(&pl, pl.stages[0].file)
+           : pipeline_load_text(&pl, pl.stages[0].file);
+    if (rc != 0) {
+        printf("Failed to open file.\n");
+        pl.failed = 1;
+    }
+
+    pipeline_finish(&pl);
+    if (pl.failed)
+        return 1;
+
+    for (int i = 0; i < pl.count; i++)
+        print_stage_result(&pl.stages[i]);
+    return 0;
+}
+
+/* ============================
+   Benchmark Harness
+   ============================ */
+#define BENCH_MIN_ELEMENTS    1000
+#define BENCH_DEFAULT_MAX     10000000      /* --bench with no size */
+#define BENCH_IO_MAX          100000000     /* load/save skipped above this */
+#define BENCH_SAMPLES         9             /* median of this many samples */
+#define BENCH_SAMPLE_SECONDS  0.05          /* timed work per sample, at least */
+#define BENCH_NOISE_FACTOR    3.0           /* flag only changes this many times the spread */
+#define BENCH_NOISE_FLOOR     100e-6        /* runs shorter than this are never flagged */
+#define BENCH_RETRIES         3             /* re-measurements before a slowdown counts */
+#define BENCH_REF_STEPS       (1 << 20)     /* length of the reference loop */
+#define BENCH_MAX_QUERIES     (1 << 20)
+#define BENCH_TEXT_FILE       "bench_data.txt"
+#define BENCH_COLUMN_FILE     "bench_data.bin"
+
+typedef struct {
+    const char *pattern;
+    size_t n;
+    Dataset ds;
+    int *queries;
+    size_t q;
+    long long *found;
+    uint64_t rng;
+    volatile long long sink;   /* keeps results live */
+} BenchState;
+
+typedef struct {
+    double seconds;        /* median time of one run */
+    double cycles;         /* median TSC ticks of one run */
+    double relative;       /* median time of one run / reference loop time */
+    double noisePct;       /* interquartile spread of `relative`, % of the median */
+} BenchTiming;
+
+typedef struct {
+    char pattern[16];
+    char op[16];
+    size_t n;
+    double nsPerElement;
+    double relPerElement;  /* 0 in files written before it existed */
+    double noisePct;
+} BenchRecord;
+
+typedef struct {
+    BenchRecord *items;
+    size_t count;
+    size_t capacity;
+} BenchRecords;
+
+static const char *bench_patterns[] = { "random", "sorted", "reverse", "few_unique" };
+
+static double bench_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+/* Time-stamp counter ticks (reference cycles); 0 where there is none */
+static inline uint64_t bench_cycles(void) {
+#ifdef HAVE_X86_KERNELS
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static inline uint64_t bench_next(BenchState *b) {
+    b->rng ^= b->rng << 13;
+    b->rng ^= b->rng >> 7;
+    b->rng ^= b->rng << 17;
+    return b->rng;
+}
+
+/* Regenerates the input, so sorts can run again without a spare copy */
+static void bench_fill(BenchState *b) {
+    int *v = b->ds.values;
+    size_t n = b->n;
+    b->rng = 0x2545f4914f6cdd1dULL;
+
+    if (strcmp(b->pattern, "random") == 0) {
+        for (size_t i = 0; i < n; i++)
+            v[i] = (int)(uint32_t)bench_next(b);
+    } else if (strcmp(b->pattern, "sorted") == 0) {
+        for (size_t i = 0; i < n; i++)
+            v[i] = (int)(i - n / 2);
+    } else if (strcmp(b->pattern, "reverse") == 0) {
+        for (size_t i = 0; i < n; i++)
+            v[i] = (int)(n / 2 - i);
+    } else {
+        for (size_t i = 0; i < n; i++)
+            v[i] = (int)(bench_next(b) % 16);
+    }
+    b->ds.stats.valid = 0;
+    dataset_changed(&b->ds);
+}
+
+//   Timed bodies: one repetition each
+
+static void bench_summary(BenchState *b) {
+    Summary s;
+    b->ds.stats.valid = 0;           /* time the full pass, not the cached answer */
+    dataset_summary(&b->ds, &s);
+    b->sink += s.sum + s.min + s.max;
+}
+
+static void bench_sort(BenchState *b) {
+    sort_dataset(b->ds.values, b->n, 0);
+}
+
+static void bench_index_drop(BenchState *b) {
+    dataset_changed(&b->ds);
+}
+
+static void bench_index_build(BenchState *b) {
+    int found;
+    size_t rank;
+    b->sink += index_lower_bound(&b->ds, 0, &found, &rank);
+}
+
+static void bench_search(BenchState *b) {
+    b->sink += (long long)index_lookup_batch(&b->ds, b->queries, b->q, b->found);
+}
+
+static void bench_save_text(BenchState *b) {
+    FILE *fp = fopen(BENCH_TEXT_FILE, "w");
+    if (fp) {
+        b->sink += text_write_values(fp, b->ds.values, b->n);
+        fclose(fp);
+    }
+}
+
+static void bench_load_text(BenchState *b) {
+    int *values;
+    size_t count;
+    if (load_text_dataset(BENCH_TEXT_FILE, &values, &count) == 0) {
+        b->sink += (long long)count;
+        free(values);
+    }
+}
+
+static void bench_save_column(BenchState *b) {
+    b->sink += column_write(BENCH_COLUMN_FILE, b->ds.values, b->n, COLUMN_INT32, 0);
+}
+
+static void bench_load_column(BenchState *b) {
+    int *values;
+    size_t count;
+    if (column_load(BENCH_COLUMN_FILE, &values, &count) == 0) {
+        b->sink += (long long)count;
+        free(values);
+    }
+}
+
+/*
+ * Time of a fixed loop with no memory traffic: a yardstick for how fast
+ * the machine is running at the moment. Virtual machines and laptops
+ * change speed by tens of percent from one second to the next, so
+ * results are compared relative to this, measured next to them.
+ */
+static double bench_reference(BenchState *b) {
+    uint64_t x = b->rng | 1;
+    double t0 = bench_seconds();
+    for (int i = 0; i < BENCH_REF_STEPS; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+    }
+    double t = bench_seconds() - t0;
+    b->sink += (long long)(x & 1);
+    return t;
+}
+
+static int bench_compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Median time (and TSC cycles) for one run of `run`, over BENCH_SAMPLES
+ * samples. After an untimed warm-up, each sample repeats the run until
+ * at least BENCH_SAMPLE_SECONDS of it have been timed, so short runs are
+ * not at the mercy of timer resolution and one-off stalls. With
+ * `prepare`, every run gets its own untimed prepare() first. The
+ * reference loop is timed before and after every sample; the spread of
+ * the relative times between the quartile samples is kept as the
+ * result's noise level.
+ */
+static void bench_measure(BenchState *b, void (*prepare)(BenchState *),
+                          void (*run)(BenchState *), BenchTiming *out) {
+    if (prepare)
+        prepare(b);
+    double warm = bench_seconds();
+    run(b);
+    warm = bench_seconds() - warm;
+
+    size_t batch = warm < BENCH_SAMPLE_SECONDS
+                 ? (size_t)(BENCH_SAMPLE_SECONDS / (warm > 1e-7 ? warm : 1e-7)) + 1 : 1;
+    double times[BENCH_SAMPLES], ticks[BENCH_SAMPLES], rel[BENCH_SAMPLES];
+
+    for (size_t s = 0; s < BENCH_SAMPLES; s++) {
+        double t = 0, c = 0, ref = bench_reference(b);
+        if (prepare) {
+            for (size_t r = 0; r < batch; r++) {
+                prepare(b);
+                uint64_t c0 = bench_cycles();
+                double t0 = bench_seconds();
+                run(b);
+                t += bench_seconds() - t0;
+                c += (double)(bench_cycles() - c0);
+            }
+        } else {
+            uint64_t c0 = bench_cycles();
+            double t0 = bench_seconds();
+            for (size_t r = 0; r < batch; r++)
+                run(b);
+            t = bench_seconds() - t0;
+            c = (double)(bench_cycles() - c0);
+        }
+        times[s] = t / (double)batch;
+        ticks[s] = c / (double)batch;
+        ref = (ref + bench_reference(b)) / 2;
+        rel[s] = times[s] / ref;
+    }
+
+    qsort(times, BENCH_SAMPLES, sizeof(double), bench_compare_doubles);
+    qsort(ticks, BENCH_SAMPLES, sizeof(double), bench_compare_doubles);
+    qsort(rel, BENCH_SAMPLES, sizeof(double), bench_compare_doubles);
+    out->seconds = times[BENCH_SAMPLES / 2];
+    out->cycles = ticks[BENCH_SAMPLES / 2];
+    out->relative = rel[BENCH_SAMPLES / 2];
+    out->noisePct = (rel[BENCH_SAMPLES * 3 / 4] - rel[BENCH_SAMPLES / 4]) / out->relative * 100.0;
+}
+
+/* Reads records back from a previous --bench run's JSON */
+static int bench_load_baseline(const char *filename, BenchRecords *out) {
+    char *text;
+    if (read_text_file(filename, &text) != 0)
+        return -1;
+
+    for (char *line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+        char *pattern = strstr(line, "\"pattern\": \"");
+        char *op = strstr(line, "\"op\": \"");
+        char *n = strstr(line, "\"n\": ");
+        char *ns = strstr(line, "\"ns_per_element\": ");
+        char *noise = strstr(line, "\"noise_pct\": ");
+        char *rel = strstr(line, "\"relative_per_element\": ");
+        if (!pattern || !op || !n || !ns)
+            continue;
+
+        if (out->count == out->capacity) {
+            size_t cap = out->capacity ? out->capacity * 2 : 64;
+            BenchRecord *items = realloc(out->items, cap * sizeof(BenchRecord));
+            if (!items) {
+                free(text);
+                return -1;
+            }
+            out->items = items;
+            out->capacity = cap;
+        }
+        BenchRecord *rec = &out->items[out->count++];
+        sscanf(pattern + 12, "%15[^\"]", rec->pattern);
+        sscanf(op + 7, "%15[^\"]", rec->op);
+        rec->n = (size_t)strtoull(n + 5, NULL, 10);
+        rec->nsPerElement = strtod(ns + 18, NULL);
+        rec->noisePct = noise ? strtod(noise + 13, NULL) : 0;
+        rec->relPerElement = rel ? strtod(rel + 24, NULL) : 0;
+    }
+    free(text);
+    return 0;
+}
+
+static const BenchRecord *bench_find(const BenchRecords *recs, const char *pattern,
+                                     size_t n, const char *op) {
+    for (size_t i = 0; i < recs->count; i++) {
+        const BenchRecord *r = &recs->items[i];
+        if (r->n == n && strcmp(r->pattern, pattern) == 0 && strcmp(r->op, op) == 0)
+            return r;
+    }
+    return NULL;
+}
+
+/*
+ * The slowdown (in %) that counts as a regression for a result: beyond
+ * `tolerance` and also beyond BENCH_NOISE_FACTOR times the spread both
+ * runs measured for it, so a jittery result cannot fail the run on
+ * noise alone. Negative when the result is never flagged: runs shorter
+ * than BENCH_NOISE_FLOOR, where cache and clock-speed state between runs
+ * swamps any real change.
+ */
+static double bench_threshold(const BenchTiming *t, const BenchRecord *base, double tolerance) {
+    if (t->seconds < BENCH_NOISE_FLOOR)
+        return -1;
+    double threshold = BENCH_NOISE_FACTOR * (t->noisePct + base->noisePct);
+    return threshold > tolerance ? threshold : tolerance;
+}
+
+/* Change against the baseline, relative to the reference loop when it has that */
+static double bench_change(const BenchTiming *t, size_t elements, const BenchRecord *base) {
+    if (base->relPerElement > 0)
+        return (t->relative / (double)elements / base->relPerElement - 1.0) * 100.0;
+    return (t->seconds * 1e9 / (double)elements / base->nsPerElement - 1.0) * 100.0;
+}
+
+static int bench_regressed(const BenchTiming *t, size_t elements, const BenchRecord *base,
+                           double tolerance) {
+    double threshold = bench_threshold(t, base, tolerance);
+    return threshold >= 0 && bench_change(t, elements, base) > threshold;
+}
+
+/* Prints one result line; returns 1 if it regressed against `base` */
+static int bench_report(const BenchState *b, const char *op, size_t elements, double bytes,
+                        const BenchTiming *t, const BenchRecord *base,
+                        double tolerance, int *first) {
+    double ns = t->seconds * 1e9 / (double)elements;
+    printf("%s\n    {\"pattern\": \"%s\", \"n\": %zu, \"op\": \"%s\", \"seconds\": %.9f,",
+           *first ? "" : ",", b->pattern, b->n, op, t->seconds);
+    printf(" \"elements_per_s\": %.0f, \"gb_per_s\": %.3f,",
+           (double)elements / t->seconds, bytes / t->seconds / 1e9);
+    if (t->cycles > 0)
+        printf(" \"cycles_per_element\": %.3f,", t->cycles / (double)elements);
+    else
+        printf(" \"cycles_per_element\": null,");
+    printf(" \"ns_per_element\": %.4f, \"relative_per_element\": %.6e, \"noise_pct\": %.1f",
+           ns, t->relative / (double)elements, t->noisePct);
+    *first = 0;
+
+    int regressed = 0;
+    if (base) {
+        double threshold = bench_threshold(t, base, tolerance);
+        regressed = bench_regressed(t, elements, base, tolerance);
+        printf(", \"baseline_ns_per_element\": %.4f, \"change_pct\": %.1f",
+               base->nsPerElement, bench_change(t, elements, base));
+        if (threshold < 0)
+            printf(", \"threshold_pct\": null");
+        else
+            printf(", \"threshold_pct\": %.1f%s", threshold, regressed ? ", \"regression\": true" : "");
+    }
+    printf("}");
+    fflush(stdout);
+    return regressed;
+}
+
+static off_t bench_file_bytes(const char *filename) {
+    struct stat st;
+    return stat(filename, &st) == 0 ? st.st_size : 0;
+}
+
+/*
+ * Measures and reports one operation; returns 1 if it regressed. A result
+ * that looks slower than its baseline is measured again (keeping the
+ * fastest median) before it counts, so one slow phase of the machine
+ * cannot fail the run. With `file`, throughput is that file's size.
+ */
+static int bench_run(BenchState *b, const char *op, size_t elements, double bytes,
+                     const char *file, void (*prepare)(BenchState *), void (*run)(BenchState *),
+                     const BenchRecords *baseline, double tolerance, int *first) {
+    BenchTiming t, retry;
+    bench_measure(b, prepare, run, &t);
+
+    const BenchRecord *base = baseline ? bench_find(baseline, b->pattern, b->n, op) : NULL;
+    if (base && base->nsPerElement <= 0)
+        base = NULL;
+    for (int i = 0; i < BENCH_RETRIES && base && bench_regressed(&t, elements, base, tolerance); i++) {
+        bench_measure(b, prepare, run, &retry);
+        if (retry.relative < t.relative)
+            t = retry;
+    }
+
+    if (file)
+        bytes = (double)bench_file_bytes(file);
+    return bench_report(b, op, elements, bytes, &t, base, tolerance, first);
+}
+
+/*
+ * Times the data engine on random, sorted, reverse and few-unique int32
+ * datasets of 1K, 10K, ... up to `maxElements`, printing one JSON
+ * object per (pattern, size, operation):
+ *   sum / average / min / max   the fused pass, with cached stats dropped
+ *   index_build, search         building the search index, then a batch
+ *                               of lookups (half hits, half random)
+ *   save/load_text, save/load_column   round trips through files in the
+ *                               working directory (up to BENCH_IO_MAX)
+ *   sort                        ascending sort of the freshly generated input
+ * Each figure is the median of BENCH_SAMPLES samples of at least
+ * BENCH_SAMPLE_SECONDS, with the samples' spread as noise_pct.
+ * Throughput is elements (or queries) per second and bytes per second;
+ * cycles come from the time-stamp counter. With a baseline (the JSON of
+ * an earlier run), each line also shows the change in ns per element,
+ * and the exit status is 1 if anything still got slower than its
+ * threshold (`tolerance` % or the noise, see bench_threshold()) after
+ * being re-measured.
+ * A `maxElements` of 0 means BENCH_DEFAULT_MAX.
+ */
+int run_benchmark(size_t maxElements, const char *baselineFile, double tolerance) {
+    if (maxElements == 0)
+        maxElements = BENCH_DEFAULT_MAX;
+    if (maxElements < BENCH_MIN_ELEMENTS) {
+        printf("The benchmark needs at least %d elements.\n", BENCH_MIN_ELEMENTS);
+        return 1;
+    }
+    BenchRecords baseline = { 0 };
+    if (baselineFile && bench_load_baseline(baselineFile, &baseline) != 0) {
+        printf("Failed to read baseline %s.\n", baselineFile);
+        return 1;
+    }
+
+    printf("{\n  \"benchmark\": \"data_processing\",\n");
+    printf("  \"describe_kernel\": \"%s\",\n  \"threads\": %d,\n",
+           describe_kernel_name(), available_threads());
+    if (baselineFile)
+        printf("  \"baseline\": \"%s\",\n  \"tolerance_pct\": %.1f,\n", baselineFile, tolerance);
+    printf("  \"results\": [");
+
+    int first = 1, regressions = 0, stopped = 0;
+    const BenchRecords *base = baselineFile ? &baseline : NULL;
+
+    for (size_t n = BENCH_MIN_ELEMENTS; n <= maxElements && !stopped; n *= 10) {
+        for (size_t p = 0; p < sizeof(bench_patterns) / sizeof(bench_patterns[0]); p++) {
+            BenchState b;
+            memset(&b, 0, sizeof(b));
+            b.pattern = bench_patterns[p];
+            b.n = n;
+            if (dataset_reserve(&b.ds, n) != 0) {
+                stopped = 1;
+                break;
+            }
+            b.ds.size = n;
+            bench_fill(&b);
+
+            double bytes = (double)n * sizeof(int);
+            /* sum, average, min and max all come from this one fused pass */
+            regressions += bench_run(&b, "describe", n, bytes, NULL, NULL, bench_summary,
+                                     base, tolerance, &first);
+
+            /* the index needs memory a scan would not: skip it if that fails */
+            b.q = n < BENCH_MAX_QUERIES ? n : BENCH_MAX_QUERIES;
+            b.queries = malloc(b.q * sizeof(int));
+            b.found = malloc(b.q * sizeof(long long));
+            int found;
+            size_t rank;
+            if (b.queries && b.found && index_lower_bound(&b.ds, 0, &found, &rank) == 0) {
+                for (size_t i = 0; i < b.q; i++)
+                    b.queries[i] = (i & 1) ? (int)(uint32_t)bench_next(&b)
+                                           : b.ds.values[bench_next(&b) % n];
+
+                regressions += bench_run(&b, "index_build", n, bytes, NULL, bench_index_drop,
+                                         bench_index_build, base, tolerance, &first);
+                regressions += bench_run(&b, "search", b.q, (double)b.q * sizeof(int), NULL,
+                                         NULL, bench_search, base, tolerance, &first);
+            }
+            free(b.queries);
+            free(b.found);
+            index_invalidate(&b.ds.index);
+
+            if (n <= BENCH_IO_MAX) {
+                static const struct {
+                    const char *op;
+                    const char *file;
+                    void (*run)(BenchState *);
+                } io[] = {
+                    { "save_text",   BENCH_TEXT_FILE,   bench_save_text },
+                    { "load_text",   BENCH_TEXT_FILE,   bench_load_text },
+                    { "save_column", BENCH_COLUMN_FILE, bench_save_column },
+                    { "load_column", BENCH_COLUMN_FILE, bench_load_column }
+                };
+                for (size_t k = 0; k < sizeof(io) / sizeof(io[0]); k++) {
+                    regressions += bench_run(&b, io[k].op, n, 0, io[k].file, NULL, io[k].run,
+                                             base, tolerance, &first);
+                }
+                unlink(BENCH_TEXT_FILE);
+                unlink(BENCH_COLUMN_FILE);
+            }
+
+            regressions += bench_run(&b, "sort", n, bytes, NULL, bench_fill, bench_sort,
+                                     base, tolerance, &first);
+
+            dataset_free(&b.ds);
+        }
+    }
+
+    printf("\n  ]");
+    if (stopped)
+        printf(",\n  \"stopped\": \"not enough memory for larger datasets\"");
+    if (baselineFile)
+        printf(",\n  \"regressions\": %d", regressions);
+    printf("\n}\n");
+    free(baseline.items);
+    return regressions > 0;
 }
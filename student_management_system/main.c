@@ -1,11 +1,34 @@
+#define _GNU_SOURCE   // strcasestr
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #define MAX_NAME 50
 #define MAX_COURSE 50
 #define MAX_GRADES 10
 #define FILE_NAME "students.dat"
+#define COMPACT_FILE "students.dat.tmp"
+#define WAL_FILE "students.wal"
+#define INDEX_FILE "students.idx"
+#define INDEX_TMP_FILE "students.idx.tmp"
+#define INDEX_MAGIC "SIX1"
+#define STORE_MAGIC "SMS2"
+#define STORE_VERSION 2
+#define STORE_V1_HEADER 16      // version 1 headers had no generation
+#define SEARCH_PAGE 10           // search results shown at a time
+#define STATS_BINS 1000          // GPA histogram: 0.1 wide from 0 to 100
+#define AGE_BAND_YEARS 5
+#define AGE_BANDS 12             // the last band is 55 and over
+#define COMPACT_MIN_DEAD 64     // fewer tombstones than this aren't worth a rewrite
+#define CHECKPOINT_BYTES (4 << 20)  // checkpoint once the log is this big...
+#define CHECKPOINT_SECONDS 30       // ...or this long after the last one
 
 // Struct
 typedef struct {
@@ -18,44 +41,837 @@ typedef struct {
   float gpa;
 } Student;
 
-// global dynamic array
+// students.dat is a StoreHeader followed by one Student per fixed-size
+// slot. A delete negates the slot's id (a tombstone) instead of moving
+// anything; the maintenance thread later rewrites the file without them.
+typedef struct {
+  char magic[4];
+  uint32_t version;
+  uint32_t recordSize;
+  int32_t nextID;
+  uint32_t generation;  // bumped by every rewrite; log records carry it
+  uint32_t reserved;
+} StoreHeader;
+
+// Changes reach students.dat through students.wal: each add, update or
+// delete appends the slot's new contents, and the change counts as saved
+// once the log is synced. Checkpoints copy changed slots into the main
+// file and empty the log; startup replays whatever is left in it.
+enum { WAL_ADD = 1, WAL_UPDATE, WAL_DELETE };
+
+typedef struct {
+  uint32_t checksum;    // CRC-32 of the rest of the record
+  uint32_t generation;  // records from before a rewrite are skipped
+  int32_t op;
+  int32_t slot;
+  Student student;
+} WalRecord;
+
+typedef struct {
+  char *data;
+  size_t used;
+  size_t capacity;
+} WalBuffer;
+
+// global dynamic array, indexed by slot: students[i] is slot i on disk
 Student *students = NULL;
-int studentCount = 0;
+int slotCount = 0;      // slots in use, tombstones included
+int slotCapacity = 0;
+int studentCount = 0;   // live students
 int autoID = 1;
 
+// slots changed since the last checkpoint
+unsigned char *slotDirty = NULL;
+int *dirtySlots = NULL;
+int dirtyCount = 0;
+int dirtyCapacity = 0;
+
+// open students.dat; storeLock covers it and everything above
+int storeFd = -1;
+uint32_t storeGeneration = 0;
+time_t lastCheckpoint = 0;
+pthread_mutex_t storeLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t maintenanceWanted = PTHREAD_COND_INITIALIZER;
+pthread_t maintenance;
+int maintenanceRunning = 0;
+int maintenanceStop = 0;
+
+// the log; walLock covers these, and is never held while taking storeLock
+int walFd = -1;
+WalBuffer walPending = {0};     // appended, not yet written
+WalBuffer walSpare = {0};       // the writer's other buffer
+uint64_t walAppended = 0;       // records appended so far
+uint64_t walDurable = 0;        // records written and synced so far
+off_t walSize = 0;
+int walFailed = 0;
+pthread_mutex_t walLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t walWork = PTHREAD_COND_INITIALIZER;
+pthread_cond_t walDone = PTHREAD_COND_INITIALIZER;
+pthread_t walWriter;
+int walWriterRunning = 0;
+int walStop = 0;
+
+uint32_t crcTable[256];
+
+void buildCrcTable() {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++)
+      c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    crcTable[i] = c;
+  }
+}
+
+uint32_t crc32(const void *data, size_t len) {
+  const unsigned char *p = data;
+  uint32_t c = 0xFFFFFFFFu;
+  while (len--)
+    c = crcTable[(c ^ *p++) & 0xFF] ^ (c >> 8);
+  return c ^ 0xFFFFFFFFu;
+}
+
+uint32_t recordChecksum(const WalRecord *rec) {
+  return crc32((const char *)rec + sizeof(rec->checksum), sizeof(*rec) - sizeof(rec->checksum));
+}
+
+int isLive(const Student *s) {
+  return s->id > 0;
+}
+
+off_t slotOffset(int slot) {
+  return (off_t)sizeof(StoreHeader) + (off_t)slot * sizeof(Student);
+}
+
+int reserveSlots(int count) {
+  if (count <= slotCapacity) return 0;
+
+  int capacity = slotCapacity ? slotCapacity : 16;
+  while (capacity < count) capacity *= 2;
+
+  Student *grown = realloc(students, capacity * sizeof(Student));
+  if (!grown) return -1;
+  students = grown;
+  unsigned char *dirty = realloc(slotDirty, capacity);
+  if (!dirty) return -1;
+  memset(dirty + slotCapacity, 0, capacity - slotCapacity);
+  slotDirty = dirty;
+  slotCapacity = capacity;
+  return 0;
+}
+
+int markDirty(int slot) {
+  if (slotDirty[slot]) return 0;
+  if (dirtyCount == dirtyCapacity) {
+    int capacity = dirtyCapacity ? dirtyCapacity * 2 : 64;
+    int *grown = realloc(dirtySlots, capacity * sizeof(int));
+    if (!grown) return -1;
+    dirtySlots = grown;
+    dirtyCapacity = capacity;
+  }
+  slotDirty[slot] = 1;
+  dirtySlots[dirtyCount++] = slot;
+  return 0;
+}
+
+void clearDirty() {
+  for (int i = 0; i < dirtyCount; i++)
+    if (dirtySlots[i] < slotCapacity)
+      slotDirty[dirtySlots[i]] = 0;
+  dirtyCount = 0;
+}
+
+int compareInts(const void *a, const void *b) {
+  int x = *(const int *)a, y = *(const int *)b;
+  return (x > y) - (x < y);
+}
+
+int writeAll(int fd, const char *data, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n <= 0) return -1;
+    data += n;
+    len -= n;
+  }
+  return 0;
+}
+
+// Group commit: everything appended while the previous batch was being
+// synced goes out together in one write and one fdatasync.
+void *walWriterMain(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&walLock);
+  for (;;) {
+    while (walPending.used == 0 && !walStop)
+      pthread_cond_wait(&walWork, &walLock);
+    if (walPending.used == 0) break;
+
+    WalBuffer batch = walPending;
+    uint64_t upTo = walAppended;
+    walPending = walSpare;
+    walPending.used = 0;
+    pthread_mutex_unlock(&walLock);
+
+    int ok = writeAll(walFd, batch.data, batch.used) == 0 && fdatasync(walFd) == 0;
+
+    pthread_mutex_lock(&walLock);
+    if (ok) {
+      walSize += batch.used;
+      walDurable = upTo;
+    } else {
+      walFailed = 1;
+    }
+    walSpare = batch;
+    pthread_cond_broadcast(&walDone);
+  }
+  pthread_mutex_unlock(&walLock);
+  return NULL;
+}
+
+// Queues the current contents of `slot` for the log and returns its
+// sequence number for walSync(), or 0 if it could not be queued. Call
+// with storeLock held, so the log sees changes in the order they happen.
+uint64_t logChange(int op, int slot) {
+  WalRecord rec;
+  memset(&rec, 0, sizeof(rec));
+  rec.generation = storeGeneration;
+  rec.op = op;
+  rec.slot = slot;
+  rec.student = students[slot];
+  rec.checksum = recordChecksum(&rec);
+
+  if (markDirty(slot) != 0) return 0;
+
+  uint64_t lsn = 0;
+  pthread_mutex_lock(&walLock);
+  if (walPending.used + sizeof(rec) > walPending.capacity) {
+    size_t capacity = walPending.capacity ? walPending.capacity * 2 : 64 * sizeof(rec);
+    char *grown = realloc(walPending.data, capacity);
+    if (grown) {
+      walPending.data = grown;
+      walPending.capacity = capacity;
+    }
+  }
+  if (walPending.used + sizeof(rec) <= walPending.capacity) {
+    memcpy(walPending.data + walPending.used, &rec, sizeof(rec));
+    walPending.used += sizeof(rec);
+    lsn = ++walAppended;
+    pthread_cond_signal(&walWork);
+  }
+  pthread_mutex_unlock(&walLock);
+  return lsn;
+}
+
+// Waits until record `lsn` (and everything before it) is on disk.
+int walSync(uint64_t lsn) {
+  pthread_mutex_lock(&walLock);
+  while (walDurable < lsn && !walFailed)
+    pthread_cond_wait(&walDone, &walLock);
+  int failed = walFailed || lsn == 0;
+  pthread_mutex_unlock(&walLock);
+  return failed ? -1 : 0;
+}
+
+// Same, for everything appended so far.
+int walSyncAll() {
+  pthread_mutex_lock(&walLock);
+  uint64_t lsn = walAppended;
+  pthread_mutex_unlock(&walLock);
+  return lsn ? walSync(lsn) : 0;
+}
+
+off_t walBytes() {
+  pthread_mutex_lock(&walLock);
+  off_t bytes = walSize + walPending.used;
+  pthread_mutex_unlock(&walLock);
+  return bytes;
+}
+
+void walTruncate() {
+  pthread_mutex_lock(&walLock);
+  if (ftruncate(walFd, 0) == 0)
+    walSize = 0;
+  pthread_mutex_unlock(&walLock);
+}
+
+// Reports a change once it is durable and nudges the maintenance thread
+// if the log has grown enough for a checkpoint. Call without storeLock.
+void commitChange(uint64_t lsn) {
+  if (walSync(lsn) != 0) {
+    printf("Error saving to file.\n");
+    return;
+  }
+  if (walBytes() >= CHECKPOINT_BYTES)
+    pthread_cond_signal(&maintenanceWanted);
+}
+
+// ID index: open addressing with linear probing from id to slot, kept
+// at most half full. Built on the first lookup, kept up to date by adds
+// and deletes, and saved next to students.dat at each checkpoint so the
+// next start can load it instead of rebuilding.
+typedef struct {
+  int32_t id;       // 0 marks an empty entry
+  int32_t slot;
+} IndexEntry;
+
+typedef struct {
+  char magic[4];
+  uint32_t generation;  // must match students.dat...
+  int32_t slotCount;    // ...and the number of slots it held at the time
+  uint32_t capacity;
+  int32_t count;
+  uint32_t checksum;    // CRC-32 of the entries
+} IndexHeader;
+
+// storeLock covers these too
+IndexEntry *idIndex = NULL;
+uint32_t indexCapacity = 0;   // a power of two
+int indexCount = 0;
+int indexValid = 0;           // 0: rebuild on the next lookup
+int indexChanged = 0;         // differs from students.idx
+
+uint32_t indexHome(int id) {
+  return ((uint32_t)id * 2654435769u) & (indexCapacity - 1);
+}
+
+int indexResize(uint32_t capacity) {
+  IndexEntry *table = calloc(capacity, sizeof(IndexEntry));
+  if (!table) return -1;
+
+  IndexEntry *old = idIndex;
+  uint32_t oldCapacity = indexCapacity;
+  idIndex = table;
+  indexCapacity = capacity;
+  for (uint32_t i = 0; i < oldCapacity; i++) {
+    if (!old[i].id) continue;
+    uint32_t h = indexHome(old[i].id);
+    while (idIndex[h].id) h = (h + 1) & (capacity - 1);
+    idIndex[h] = old[i];
+  }
+  free(old);
+  return 0;
+}
+
+void indexInsert(int id, int slot) {
+  if (!indexValid) return;
+  if ((uint64_t)(indexCount + 1) * 2 > indexCapacity &&
+      indexResize(indexCapacity ? indexCapacity * 2 : 64) != 0) {
+    indexValid = 0;               // out of memory: try again on the next lookup
+    return;
+  }
+
+  uint32_t h = indexHome(id);
+  while (idIndex[h].id && idIndex[h].id != id) h = (h + 1) & (indexCapacity - 1);
+  if (!idIndex[h].id) indexCount++;
+  idIndex[h].id = id;
+  idIndex[h].slot = slot;
+  indexChanged = 1;
+}
+
+// Deletes by shifting later entries of the probe run back, so no
+// tombstones are left behind to slow lookups down.
+void indexRemove(int id) {
+  if (!indexValid || !indexCapacity) return;
+
+  uint32_t mask = indexCapacity - 1;
+  uint32_t h = indexHome(id);
+  while (idIndex[h].id && idIndex[h].id != id) h = (h + 1) & mask;
+  if (!idIndex[h].id) return;
+
+  uint32_t hole = h;
+  for (uint32_t next = (h + 1) & mask; idIndex[next].id; next = (next + 1) & mask) {
+    uint32_t home = indexHome(idIndex[next].id);
+    // move it back unless its home lies after the hole, up to where it sits
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      idIndex[hole] = idIndex[next];
+      hole = next;
+    }
+  }
+  idIndex[hole].id = 0;
+  indexCount--;
+  indexChanged = 1;
+}
+
+int indexFind(int id) {
+  uint32_t h = indexHome(id);
+  while (idIndex[h].id) {
+    if (idIndex[h].id == id) return idIndex[h].slot;
+    h = (h + 1) & (indexCapacity - 1);
+  }
+  return -1;
+}
+
+int indexBuild() {
+  uint32_t capacity = 64;
+  while (capacity < (uint32_t)studentCount * 2) capacity *= 2;
+
+  free(idIndex);
+  idIndex = NULL;
+  indexCapacity = 0;
+  indexCount = 0;
+  if (indexResize(capacity) != 0) return -1;
+
+  indexValid = 1;
+  for (int i = 0; i < slotCount && indexValid; i++)
+    if (isLive(&students[i]))
+      indexInsert(students[i].id, i);
+  indexChanged = 1;
+  return indexValid ? 0 : -1;
+}
+
+// Saves the index as of the last checkpoint, or removes a stale copy.
+void indexSave() {
+  if (!indexValid) {
+    unlink(INDEX_FILE);
+    return;
+  }
+  if (!indexChanged) return;
+
+  IndexHeader header;
+  memcpy(header.magic, INDEX_MAGIC, 4);
+  header.generation = storeGeneration;
+  header.slotCount = slotCount;
+  header.capacity = indexCapacity;
+  header.count = indexCount;
+  header.checksum = crc32(idIndex, indexCapacity * sizeof(IndexEntry));
+
+  FILE *fp = fopen(INDEX_TMP_FILE, "wb");
+  int ok = fp && fwrite(&header, sizeof(header), 1, fp) == 1 &&
+           fwrite(idIndex, sizeof(IndexEntry), indexCapacity, fp) == indexCapacity;
+  if (fp && fclose(fp) != 0) ok = 0;
+  if (ok && rename(INDEX_TMP_FILE, INDEX_FILE) == 0) {
+    indexChanged = 0;
+  } else {
+    unlink(INDEX_TMP_FILE);
+    unlink(INDEX_FILE);
+  }
+}
+
+// Loads students.idx if it was saved against exactly the slots in
+// students.dat; otherwise the index is left to be rebuilt when needed.
+void indexLoad() {
+  IndexHeader header;
+  FILE *fp = fopen(INDEX_FILE, "rb");
+  if (!fp) return;
+
+  if (fread(&header, sizeof(header), 1, fp) == 1 && memcmp(header.magic, INDEX_MAGIC, 4) == 0 &&
+      header.generation == storeGeneration && header.slotCount == slotCount &&
+      header.capacity >= 64 && (header.capacity & (header.capacity - 1)) == 0 &&
+      (idIndex = malloc(header.capacity * sizeof(IndexEntry))) != NULL &&
+      fread(idIndex, sizeof(IndexEntry), header.capacity, fp) == header.capacity &&
+      crc32(idIndex, header.capacity * sizeof(IndexEntry)) == header.checksum) {
+    indexCapacity = header.capacity;
+    indexCount = header.count;
+    indexValid = 1;
+  } else {
+    free(idIndex);
+    idIndex = NULL;
+  }
+  fclose(fp);
+}
+
+// Name/course index: for each case-folded trigram, the slots whose name
+// or course contains it, in ascending order. Built on the first search
+// and extended by adds; deleted slots are only skipped, and the whole
+// thing is rebuilt once they outnumber the live ones.
+typedef struct {
+  uint32_t key;     // three folded bytes; 0 marks an empty entry
+  int *slots;
+  int count;
+  int capacity;
+} Posting;
+
+// storeLock covers these too
+Posting *textIndex = NULL;
+uint32_t textCapacity = 0;    // a power of two
+int textKeys = 0;
+int textValid = 0;            // 0: rebuild on the next search
+int textStale = 0;            // deleted slots still in the lists
+
+unsigned char foldChar(char c) {
+  return (unsigned char)tolower((unsigned char)c);
+}
+
+uint32_t trigramKey(const char *s) {
+  return (uint32_t)foldChar(s[0]) << 16 | (uint32_t)foldChar(s[1]) << 8 | foldChar(s[2]);
+}
+
+uint32_t textHome(uint32_t key) {
+  return (key * 2654435769u) & (textCapacity - 1);
+}
+
+void textFree() {
+  for (uint32_t i = 0; i < textCapacity; i++)
+    free(textIndex[i].slots);
+  free(textIndex);
+  textIndex = NULL;
+  textCapacity = 0;
+  textKeys = 0;
+  textValid = 0;
+  textStale = 0;
+}
+
+int textResize(uint32_t capacity) {
+  Posting *table = calloc(capacity, sizeof(Posting));
+  if (!table) return -1;
+
+  Posting *old = textIndex;
+  uint32_t oldCapacity = textCapacity;
+  textIndex = table;
+  textCapacity = capacity;
+  for (uint32_t i = 0; i < oldCapacity; i++) {
+    if (!old[i].key) continue;
+    uint32_t h = textHome(old[i].key);
+    while (textIndex[h].key) h = (h + 1) & (capacity - 1);
+    textIndex[h] = old[i];
+  }
+  free(old);
+  return 0;
+}
+
+// The list for `key`, or NULL if it has none (and `create` is 0 or
+// there is no memory for it).
+Posting *textPosting(uint32_t key, int create) {
+  if (create && (uint64_t)(textKeys + 1) * 2 > textCapacity &&
+      textResize(textCapacity ? textCapacity * 2 : 1024) != 0)
+    return NULL;
+  if (!textCapacity) return NULL;
+
+  uint32_t h = textHome(key);
+  while (textIndex[h].key) {
+    if (textIndex[h].key == key) return &textIndex[h];
+    h = (h + 1) & (textCapacity - 1);
+  }
+  if (!create) return NULL;
+  textIndex[h].key = key;
+  textKeys++;
+  return &textIndex[h];
+}
+
+int textAddString(const char *s, int slot) {
+  size_t len = strlen(s);
+  for (size_t i = 0; i + 3 <= len; i++) {
+    Posting *p = textPosting(trigramKey(s + i), 1);
+    if (!p) return -1;
+    if (p->count && p->slots[p->count - 1] == slot) continue;   // repeated trigram
+    if (p->count == p->capacity) {
+      int capacity = p->capacity ? p->capacity * 2 : 4;
+      int *grown = realloc(p->slots, capacity * sizeof(int));
+      if (!grown) return -1;
+      p->slots = grown;
+      p->capacity = capacity;
+    }
+    p->slots[p->count++] = slot;
+  }
+  return 0;
+}
+
+// Indexes a newly added slot. Slots are added in increasing order, and
+// updates never change the name or course, so the lists stay sorted
+// by appending.
+void textIndexSlot(int slot) {
+  if (!textValid) return;
+  if (textAddString(students[slot].name, slot) != 0 ||
+      textAddString(students[slot].course, slot) != 0)
+    textFree();                   // out of memory: try again on the next search
+}
+
+void textRemoved() {
+  if (textValid && ++textStale > studentCount && textStale > 1024)
+    textFree();
+}
+
+int textBuild() {
+  textFree();
+  textValid = 1;
+  for (int i = 0; i < slotCount && textValid; i++)
+    if (isLive(&students[i]))
+      textIndexSlot(i);
+  return textValid ? 0 : -1;
+}
+
+// Replays the log over the slots just read from students.dat. Stops at
+// the first torn or damaged record and cuts the log back to there.
+int replayLog() {
+  WalRecord rec;
+  off_t good = 0;
+  int applied = 0;
+
+  while (pread(walFd, &rec, sizeof(rec), good) == sizeof(rec) &&
+         rec.checksum == recordChecksum(&rec) && rec.slot >= 0) {
+    if (rec.generation == storeGeneration) {
+      if (reserveSlots(rec.slot + 1) != 0) return -1;
+      while (slotCount <= rec.slot)
+        memset(&students[slotCount++], 0, sizeof(Student));
+      students[rec.slot] = rec.student;
+      // a slot keeps one id for its life, so this is right even if a
+      // crash mid-checkpoint left students.dat ahead of the index
+      indexRemove(abs(rec.student.id));
+      if (isLive(&rec.student)) indexInsert(rec.student.id, rec.slot);
+      if (markDirty(rec.slot) != 0) return -1;
+      applied++;
+    }
+    good += sizeof(rec);
+  }
+
+  if (ftruncate(walFd, good) != 0) return -1;
+  walSize = good;
+  return applied;
+}
+
+// Copies every slot changed since the last checkpoint into students.dat,
+// syncs it, and empties the log. Call with storeLock held.
+int checkpoint() {
+  lastCheckpoint = time(NULL);
+  if (walSyncAll() != 0) return -1;
+
+  // in slot order, one pwrite per run of neighbouring slots
+  qsort(dirtySlots, dirtyCount, sizeof(int), compareInts);
+  for (int i = 0; i < dirtyCount; ) {
+    int first = dirtySlots[i], run = 1;
+    while (i + run < dirtyCount && dirtySlots[i + run] == first + run) run++;
+    size_t bytes = (size_t)run * sizeof(Student);
+    if (pwrite(storeFd, &students[first], bytes, slotOffset(first)) != (ssize_t)bytes)
+      return -1;
+    i += run;
+  }
+  if (dirtyCount > 0 && fdatasync(storeFd) != 0) return -1;
+
+  indexSave();
+  walTruncate();
+  clearDirty();
+  return 0;
+}
+
+int syncDirectory() {
+  int fd = open(".", O_RDONLY);
+  if (fd < 0) return -1;
+  int rc = fsync(fd);
+  close(fd);
+  return rc;
+}
+
+// Writes the live students to a fresh file under a new generation and
+// swaps it in with rename(), so a crash leaves either the old file or the
+// new one; log records from before the swap no longer apply to it. Slots
+// are renumbered. Call with storeLock held (or before the threads start).
+int rewriteStore() {
+  if (walSyncAll() != 0) {
+    printf("Error saving to file.\n");
+    return -1;
+  }
+
+  int fd = open(COMPACT_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    printf("Error saving to file.\n");
+    return -1;
+  }
+
+  StoreHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, STORE_MAGIC, 4);
+  header.version = STORE_VERSION;
+  header.recordSize = sizeof(Student);
+  header.nextID = autoID;
+  header.generation = storeGeneration + 1;
+
+  FILE *fp = fdopen(fd, "wb");
+  int ok = fp && fwrite(&header, sizeof(header), 1, fp) == 1;
+  for (int i = 0; ok && i < slotCount; i++)
+    if (isLive(&students[i]))
+      ok = fwrite(&students[i], sizeof(Student), 1, fp) == 1;
+  ok = ok && fflush(fp) == 0 && fsync(fd) == 0;
+
+  int newFd = ok ? dup(fd) : -1;
+  if (fp) fclose(fp); else close(fd);
+  if (newFd < 0 || rename(COMPACT_FILE, FILE_NAME) != 0) {
+    if (newFd >= 0) close(newFd);
+    unlink(COMPACT_FILE);
+    printf("Error saving to file.\n");
+    return -1;
+  }
+  syncDirectory();
+
+  // the new file holds everything, so the log can go
+  if (storeFd >= 0) close(storeFd);
+  storeFd = newFd;
+  storeGeneration++;
+  walTruncate();
+  clearDirty();
+  lastCheckpoint = time(NULL);
+  indexValid = 0;                  // slots move: rebuild on the next lookup
+  textFree();
+
+  // squeeze the tombstones out in memory to match
+  int live = 0;
+  for (int i = 0; i < slotCount; i++)
+    if (isLive(&students[i]))
+      students[live++] = students[i];
+  slotCount = live;
+  studentCount = live;
+  return 0;
+}
+
+int needsCompaction() {
+  int dead = slotCount - studentCount;
+  return dead >= COMPACT_MIN_DEAD && dead > studentCount;
+}
+
+// Background maintenance: compacts once deletes leave more tombstones
+// than live records, and checkpoints when the log gets big or old.
+void *maintenanceMain(void *arg) {
+  (void)arg;
+  pthread_mutex_lock(&storeLock);
+  while (!maintenanceStop) {
+    time_t now = time(NULL);
+    int idle = 0;
+    if (needsCompaction())
+      idle = rewriteStore() != 0;
+    else if (dirtyCount > 0 && (walBytes() >= CHECKPOINT_BYTES ||
+                                now - lastCheckpoint >= CHECKPOINT_SECONDS))
+      idle = checkpoint() != 0;
+    else
+      idle = 1;
+
+    // nothing to do (or it failed): sleep until woken or the next checkpoint is due
+    if (idle && !maintenanceStop) {
+      struct timespec until = { now + CHECKPOINT_SECONDS, 0 };
+      pthread_cond_timedwait(&maintenanceWanted, &storeLock, &until);
+    }
+  }
+  pthread_mutex_unlock(&storeLock);
+  return NULL;
+}
+
+// Reads the count-prefixed array older versions wrote, so it can be
+// converted to the slot format.
+int loadLegacyFile(FILE *fp) {
+  int count = 0;
+  if (fread(&count, sizeof(int), 1, fp) != 1 || count < 0 || reserveSlots(count) != 0)
+    return -1;
+  if (fread(students, sizeof(Student), count, fp) != (size_t)count)
+    return -1;
+  slotCount = count;
+  return 0;
+}
+
+// Reads the slots that follow a header of `headerSize` bytes.
+int loadSlots(FILE *fp, size_t headerSize) {
+  struct stat st;
+  if (fstat(fileno(fp), &st) != 0) return -1;
+
+  // a torn append leaves a partial slot at the end: ignore it
+  int count = (int)((st.st_size - (off_t)headerSize) / (off_t)sizeof(Student));
+  if (count < 0 || reserveSlots(count) != 0 ||
+      fread(students, sizeof(Student), count, fp) != (size_t)count)
+    return -1;
+  slotCount = count;
+  return 0;
+}
+
 void loadFromFile(){
   printf("Welcome to the Student Management System\n");
   printf("Loading data from existing file...\n");
+  buildCrcTable();
+
+  int converted = 0;
   FILE *fp = fopen(FILE_NAME, "rb");
   if (!fp) {
     printf("No existing file. No data to be loaded.\n");
-    return;
+    converted = 1;                     // start a new store
+  } else {
+    StoreHeader header;
+    memset(&header, 0, sizeof(header));
+    int rc;
+    if (fread(&header, STORE_V1_HEADER, 1, fp) == 1 &&
+        memcmp(header.magic, STORE_MAGIC, 4) == 0 && header.recordSize == sizeof(Student)) {
+      if (header.version == 1) {
+        rc = loadSlots(fp, STORE_V1_HEADER);
+        converted = 1;
+      } else if (header.version == STORE_VERSION &&
+                 fread((char *)&header + STORE_V1_HEADER, sizeof(header) - STORE_V1_HEADER, 1, fp) == 1) {
+        rc = loadSlots(fp, sizeof(header));
+      } else {
+        printf("Unsupported data file.\n");
+        fclose(fp);
+        exit(1);
+      }
+      storeGeneration = header.generation;
+      autoID = header.nextID;
+    } else {
+      rewind(fp);
+      rc = loadLegacyFile(fp);
+      converted = 1;
+    }
+    fclose(fp);
+    if (rc != 0) {
+      printf("Error reading data file.\n");
+      exit(1);
+    }
   }
-  fread(&studentCount, sizeof(int), 1, fp);
-  if (studentCount > 0) {
-      students = malloc(studentCount * sizeof(Student));
-      fread(students, sizeof(Student), studentCount, fp);
-      autoID = students[studentCount - 1].id + 1;
+
+  indexLoad();
+  walFd = open(WAL_FILE, O_RDWR | O_CREAT | O_APPEND, 0644);
+  int replayed = walFd < 0 ? -1 : replayLog();
+  if (replayed < 0) {
+    printf("Error reading log file.\n");
+    exit(1);
   }
+  if (replayed > 0)
+    printf("Recovered %d unsaved change(s) from the log.\n", replayed);
 
-  fclose(fp);
-  printf("Data loaded successfully.\n");
-}
+  // ids of tombstones still count, so a deleted id is never handed out again
+  for (int i = 0; i < slotCount; i++) {
+    int id = abs(students[i].id);
+    if (id >= autoID) autoID = id + 1;
+    if (isLive(&students[i])) studentCount++;
+  }
 
-void saveToFile(){
-  FILE *fp = fopen(FILE_NAME, "wb");
-  if (!fp) {
+  if (!converted && (storeFd = open(FILE_NAME, O_RDWR)) < 0) {
+    printf("Error opening data file.\n");
+    exit(1);
+  }
+  walWriterRunning = pthread_create(&walWriter, NULL, walWriterMain, NULL) == 0;
+  if (!walWriterRunning ||
+      (converted ? rewriteStore() : replayed > 0 ? checkpoint() : 0) != 0) {
     printf("Error saving to file.\n");
-    return;
+    exit(1);
   }
+  lastCheckpoint = time(NULL);
 
-  fwrite(&studentCount, sizeof(int), 1, fp);
-  fwrite(students, sizeof(Student), studentCount, fp);
+  maintenanceRunning = pthread_create(&maintenance, NULL, maintenanceMain, NULL) == 0;
+  printf("Data loaded successfully.\n");
+}
 
-  fclose(fp);
-  printf("Data saved succesfully.\n");
+// Stops the background threads after a final checkpoint.
+void closeStore() {
+  pthread_mutex_lock(&storeLock);
+  maintenanceStop = 1;
+  pthread_cond_signal(&maintenanceWanted);
+  pthread_mutex_unlock(&storeLock);
+  if (maintenanceRunning) pthread_join(maintenance, NULL);
+
+  pthread_mutex_lock(&storeLock);
+  if (checkpoint() != 0)
+    printf("Error saving to file.\n");    // the log still has the changes
+  pthread_mutex_unlock(&storeLock);
+
+  pthread_mutex_lock(&walLock);
+  walStop = 1;
+  pthread_cond_signal(&walWork);
+  pthread_mutex_unlock(&walLock);
+  if (walWriterRunning) pthread_join(walWriter, NULL);
+
+  close(storeFd);
+  close(walFd);
+  free(walPending.data);
+  free(walSpare.data);
+  free(slotDirty);
+  free(dirtySlots);
+  free(idIndex);
+  textFree();
 }
 
+
 // calculate student gpa
 void computeGPA(Student *s) {
     if (s->gradeCount == 0) { s->gpa = 0; return; }
@@ -67,96 +883,214 @@ void computeGPA(Student *s) {
     s->gpa = sum / s->gradeCount;
 }
 
+// slot of a live student, or -1; call with storeLock held
 int searchByID(int id) {
-    for (int i = 0; i < studentCount; i++)
+    if (id <= 0) return -1;
+    if (indexValid || indexBuild() == 0)
+        return indexFind(id);
+
+    // no memory for the index: fall back to a scan
+    for (int i = 0; i < slotCount; i++)
         if (students[i].id == id)
             return i;
     return -1;
 }
 
 void addStudent() {
-    students = realloc(students, (studentCount + 1) * sizeof(Student));
-    Student *s = &students[studentCount];
-
-    s->id = autoID++;
-    printf("Assigned Auto ID: %d\n", s->id);
+    Student s = {0};
 
     printf("Enter Name: ");
     getchar();
-    fgets(s->name, MAX_NAME, stdin);
-    s->name[strcspn(s->name, "\n")] = 0;
+    fgets(s.name, MAX_NAME, stdin);
+    s.name[strcspn(s.name, "\n")] = 0;
 
     printf("Enter Age: ");
-    scanf("%d", &s->age);
+    scanf("%d", &s.age);
 
     printf("Enter Course: ");
     getchar();
-    fgets(s->course, MAX_COURSE, stdin);
-    s->course[strcspn(s->course, "\n")] = 0;
+    fgets(s.course, MAX_COURSE, stdin);
+    s.course[strcspn(s.course, "\n")] = 0;
 
     printf("Enter number of grades: ");
-    scanf("%d", &s->gradeCount);
+    scanf("%d", &s.gradeCount);
+    if (s.gradeCount < 0) s.gradeCount = 0;
+    if (s.gradeCount > MAX_GRADES) s.gradeCount = MAX_GRADES;
 
-    for (int i = 0; i < s->gradeCount; i++) {
+    for (int i = 0; i < s.gradeCount; i++) {
         printf("Grade %d: ", i + 1);
-        scanf("%f", &s->grade[i]);
+        scanf("%f", &s.grade[i]);
     }
 
-    computeGPA(s);
+    computeGPA(&s);
 
+    // the new student goes in the next slot at the end of the file
+    pthread_mutex_lock(&storeLock);
+    if (reserveSlots(slotCount + 1) != 0) {
+        printf("Out of memory.\n");
+        pthread_mutex_unlock(&storeLock);
+        return;
+    }
+    s.id = autoID++;
+    students[slotCount] = s;
+    uint64_t lsn = logChange(WAL_ADD, slotCount);
+    if (!lsn) {
+        // never logged: take the slot back so memory still matches the disk
+        memset(&students[slotCount], 0, sizeof(Student));
+        autoID--;
+        pthread_mutex_unlock(&storeLock);
+        printf("Error saving to file.\n");
+        return;
+    }
+    indexInsert(s.id, slotCount);
+    textIndexSlot(slotCount);
+    slotCount++;
     studentCount++;
-    saveToFile();
+    pthread_mutex_unlock(&storeLock);
+
+    commitChange(lsn);
+    printf("Assigned Auto ID: %d\n", s.id);
 }
 
 
 // Display all student records
 void displayStudents() {
+    pthread_mutex_lock(&storeLock);
     if (studentCount == 0) {
         printf("No students to display.\n");
+        pthread_mutex_unlock(&storeLock);
         return;
     }
 
     printf("\n--- Student List ---\n");
-    for (int i = 0; i < studentCount; i++) {
+    for (int i = 0; i < slotCount; i++) {
         Student s = students[i];
+        if (!isLive(&s)) continue;
         printf("\nID: %d\nName: %s\nAge: %d\nCourse: %s\nGPA: %.2f\n",
                s.id, s.name, s.age, s.course, s.gpa);
     }
+    pthread_mutex_unlock(&storeLock);
+}
+
+
+typedef struct {
+  int slot;
+  int score;
+} Match;
+
+// How well `field` matches the folded query: whole field, prefix, start
+// of a later word, or anywhere inside. 0 if it doesn't contain it.
+int fieldScore(const char *field, const char *query, int whole, int prefix, int word, int inside) {
+    const char *hit = strcasestr(field, query);
+    if (!hit) return 0;
+    if (hit == field) return field[strlen(query)] ? prefix : whole;
+    for (; hit; hit = strcasestr(hit + 1, query))
+        if (hit[-1] == ' ' || hit[-1] == '-')
+            return word;
+    return inside;
+}
+
+int matchScore(const Student *s, const char *query) {
+    return fieldScore(s->name, query, 100, 80, 60, 40) +
+           fieldScore(s->course, query, 30, 20, 15, 10);
 }
 
+int compareMatches(const void *a, const void *b) {
+    const Match *x = a, *y = b;
+    if (x->score != y->score) return y->score - x->score;
+    int byName = strcasecmp(students[x->slot].name, students[y->slot].name);
+    if (byName) return byName;
+    return students[x->slot].id - students[y->slot].id;
+}
 
-int searchByName(char *name) {
-    for (int i = 0; i < studentCount; i++) {
+// Finds every student whose name or course contains `query` (ignoring
+// case), ranks them - name before course; whole, prefix, word, then
+// anywhere - and copies matches offset..offset+limit-1 to `out`. Returns
+// the total number of matches, or -1 if out of memory. Candidates come
+// from the rarest trigram of the query; queries under three characters
+// scan every slot. Call with storeLock held.
+int searchByName(const char *query, int offset, int limit, Match *out) {
+    if (!textValid && textBuild() != 0) return -1;
 
-        // case-insensitive compare
-        if (strcasestr(students[i].name, name) != NULL) {
+    const int *candidates = NULL;
+    int candidateCount = slotCount;        // all slots, unless narrowed below
+    size_t len = strlen(query);
+    for (size_t i = 0; i + 3 <= len; i++) {
+        Posting *p = textPosting(trigramKey(query + i), 0);
+        if (!p) return 0;                  // a trigram nobody has
+        if (!candidates || p->count < candidateCount) {
+            candidates = p->slots;
+            candidateCount = p->count;
+        }
+    }
 
-            // Print full student details
-            printf("\n--- Student Found ---\n");
-            printf("ID: %d\n", students[i].id);
-            printf("Name: %s\n", students[i].name);
-            printf("Age: %d\n", students[i].age);
-            printf("Course: %s\n", students[i].course);
-            printf("GPA: %.2f\n", students[i].gpa);
-            return i;   // student index
+    Match *matches = malloc((candidateCount ? candidateCount : 1) * sizeof(Match));
+    if (!matches) return -1;
+
+    int total = 0;
+    for (int i = 0; i < candidateCount; i++) {
+        int slot = candidates ? candidates[i] : i;
+        if (!isLive(&students[slot])) continue;
+        int score = matchScore(&students[slot], query);
+        if (score) {
+            matches[total].slot = slot;
+            matches[total].score = score;
+            total++;
         }
     }
 
-    printf("\nNo student found with name: %s\n", name);
-    return -1;
+    qsort(matches, total, sizeof(Match), compareMatches);
+    for (int i = offset; i < total && i < offset + limit; i++)
+        out[i - offset] = matches[i];
+    free(matches);
+    return total;
 }
 
-// input function to handle search by name
+// input function to handle search by name, a page of results at a time
 void search(){
 
   char nameSearch[50];
 
-  printf("Enter name to search: ");
+  printf("Enter name or course to search: ");
   getchar();
   fgets(nameSearch, 50, stdin);
   nameSearch[strcspn(nameSearch, "\n")] = 0;
 
-  searchByName(nameSearch);
+  for (int offset = 0; ; offset += SEARCH_PAGE) {
+    Match page[SEARCH_PAGE];
+
+    pthread_mutex_lock(&storeLock);
+    int total = searchByName(nameSearch, offset, SEARCH_PAGE, page);
+    int shown = total - offset < SEARCH_PAGE ? total - offset : SEARCH_PAGE;
+    for (int i = 0; i < shown; i++) {
+      Student *s = &students[page[i].slot];
+
+      // Print full student details
+      printf("\n--- Student Found ---\n");
+      printf("ID: %d\n", s->id);
+      printf("Name: %s\n", s->name);
+      printf("Age: %d\n", s->age);
+      printf("Course: %s\n", s->course);
+      printf("GPA: %.2f\n", s->gpa);
+    }
+    pthread_mutex_unlock(&storeLock);
+
+    if (total < 0) {
+      printf("Out of memory.\n");
+      return;
+    }
+    if (total == 0) {
+      printf("\nNo student found with name: %s\n", nameSearch);
+      return;
+    }
+
+    printf("\nShowing %d-%d of %d match(es).\n", offset + 1, offset + shown, total);
+    if (offset + shown >= total) return;
+
+    char more;
+    printf("Show the next page? (y/n): ");
+    if (scanf(" %c", &more) != 1 || (more != 'y' && more != 'Y')) return;
+  }
 
 }
 
@@ -168,29 +1102,120 @@ void updateStudent() {
     printf("Enter ID to update: ");
     scanf("%d", &id);
 
+    pthread_mutex_lock(&storeLock);
     int pos = searchByID(id);
+    Student s;
+    if (pos != -1) s = students[pos];
+    pthread_mutex_unlock(&storeLock);
+
     if (pos == -1) {
         printf("Student not found.\n");
         return;
     }
 
-    Student *s = &students[pos];
-
     printf("Enter new age: ");
-    scanf("%d", &s->age);
+    scanf("%d", &s.age);
 
     printf("Updating grades...\n");
     printf("Number of grades: ");
-    scanf("%d", &s->gradeCount);
+    scanf("%d", &s.gradeCount);
+    if (s.gradeCount < 0) s.gradeCount = 0;
+    if (s.gradeCount > MAX_GRADES) s.gradeCount = MAX_GRADES;
 
-    for (int i = 0; i < s->gradeCount; i++) {
+    for (int i = 0; i < s.gradeCount; i++) {
         printf("Grade %d: ", i + 1);
-        scanf("%f", &s->grade[i]);
+        scanf("%f", &s.grade[i]);
+    }
+
+  // calculates new gpa and logs just this student's slot; look the
+  // slot up again since compaction may have moved it meanwhile
+    computeGPA(&s);
+
+    pthread_mutex_lock(&storeLock);
+    pos = searchByID(id);
+    uint64_t lsn = 0;
+    if (pos != -1) {
+        Student old = students[pos];
+        students[pos] = s;
+        lsn = logChange(WAL_UPDATE, pos);
+        if (!lsn) students[pos] = old;   // never logged: keep the old record
     }
+    pthread_mutex_unlock(&storeLock);
 
-  // calculates new gpa and updates it in the file
-    computeGPA(s);
-    saveToFile();
+    if (pos == -1)
+        printf("Student not found.\n");
+    else if (!lsn)
+        printf("Error saving to file.\n");
+    else
+        commitChange(lsn);
+}
+
+// BULK UPDATE: one "<id> <age> <grade> <grade> ..." line per student.
+// The whole file is logged as one batch and synced once at the end.
+void bulkUpdate() {
+    char fileName[256];
+    printf("Enter file name: ");
+    if (scanf("%255s", fileName) != 1) return;
+
+    FILE *fp = fopen(fileName, "r");
+    if (!fp) {
+        printf("Cannot open %s.\n", fileName);
+        return;
+    }
+
+    char line[512];
+    int updated = 0, missing = 0, invalid = 0, failed = 0;
+    uint64_t lsn = 0;
+
+    pthread_mutex_lock(&storeLock);
+    while (fgets(line, sizeof(line), fp)) {
+        char *p = line, *end;
+        long id = strtol(p, &end, 10);
+        if (end == p) continue;                 // blank line
+        p = end;
+        long age = strtol(p, &end, 10);
+        if (end == p || id <= 0 || id > INT32_MAX) {
+            invalid++;
+            continue;
+        }
+
+        int pos = searchByID((int)id);
+        if (pos == -1) {
+            missing++;
+            continue;
+        }
+
+        // build the new record aside; the slot keeps the old one unless it is logged
+        Student s = students[pos];
+        s.age = (int)age;
+        s.gradeCount = 0;
+        for (p = end; s.gradeCount < MAX_GRADES; p = end) {
+            float g = strtof(p, &end);
+            if (end == p) break;
+            s.grade[s.gradeCount++] = g;
+        }
+        computeGPA(&s);
+
+        Student old = students[pos];
+        students[pos] = s;
+        uint64_t next = logChange(WAL_UPDATE, pos);
+        if (!next) {
+            students[pos] = old;
+            failed = 1;
+            break;
+        }
+        lsn = next;
+        updated++;
+    }
+    pthread_mutex_unlock(&storeLock);
+    fclose(fp);
+
+    if (lsn)
+        commitChange(lsn);
+    if (failed)
+        printf("Error saving to file.\n");
+    printf("Updated %d student(s); %d ID(s) not found, %d invalid line(s).\n",
+           updated, missing, invalid);
 }
 
 // DELETE STUDENT
@@ -199,52 +1224,222 @@ void deleteStudent() {
     printf("Enter ID to delete: ");
     scanf("%d", &id);
 
+    pthread_mutex_lock(&storeLock);
     int pos = searchByID(id);
     if (pos == -1) {
         printf("Student not found.\n");
+        pthread_mutex_unlock(&storeLock);
         return;
     }
 
-    for (int i = pos; i < studentCount - 1; i++)
-        students[i] = students[i + 1];
-
+    // tombstone the slot in place; compaction reclaims it later
+    students[pos].id = -id;
+    uint64_t lsn = logChange(WAL_DELETE, pos);
+    if (!lsn) {
+        students[pos].id = id;          // never logged: the student stays
+        pthread_mutex_unlock(&storeLock);
+        printf("Error saving to file.\n");
+        return;
+    }
     studentCount--;
-    students = realloc(students, studentCount * sizeof(Student));
+    indexRemove(id);
+    textRemoved();
+    if (needsCompaction())
+        pthread_cond_signal(&maintenanceWanted);
+    pthread_mutex_unlock(&storeLock);
 
-    saveToFile();
+    commitChange(lsn);
 }
 
-void computeStatistics() {
-    if (studentCount == 0) return;
-
-    float sum = 0, max = 0, min = 999;
-    float gp[studentCount];
-
-    for (int i = 0; i < studentCount; i++) {
-        float g = students[i].gpa;
-        sum += g;
-        if (g > max) max = g;
-        if (g < min) min = g;
-        gp[i] = g;
-    }
-
-    // Median (simple sort)
-    for (int i = 0; i < studentCount - 1; i++)
-        for (int j = 0; j < studentCount - i - 1; j++)
-            if (gp[j] > gp[j+1]) {
-                float temp = gp[j];
-                gp[j] = gp[j+1];
-                gp[j+1] = temp;
+// Rearranges v[0..n-1] so v[k] holds the k-th smallest value, with
+// nothing larger before it and nothing smaller after it (quickselect).
+void selectNth(float *v, int n, int k) {
+    int lo = 0, hi = n - 1;
+    while (lo < hi) {
+        float a = v[lo], b = v[lo + (hi - lo) / 2], c = v[hi];
+        float pivot = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+
+        int i = lo, j = hi;
+        while (i <= j) {
+            while (v[i] < pivot) i++;
+            while (v[j] > pivot) j--;
+            if (i <= j) {
+                float temp = v[i];
+                v[i] = v[j];
+                v[j] = temp;
+                i++;
+                j--;
             }
+        }
+        if (k <= j) hi = j;
+        else if (k >= i) lo = i;
+        else return;
+    }
+}
 
-    float median = gp[studentCount / 2];
-    float avg = sum / studentCount;
+typedef struct {
+    char key[MAX_COURSE];
+    int count;
+    double sum;
+    float min, max;
+} GroupStats;
+
+// Per-course groups, open-addressed on the case-folded course name.
+typedef struct {
+    GroupStats *groups;
+    int capacity;     // a power of two
+    int used;
+} GroupTable;
+
+void groupAdd(GroupStats *g, float gpa) {
+    if (g->count == 0 || gpa < g->min) g->min = gpa;
+    if (g->count == 0 || gpa > g->max) g->max = gpa;
+    g->count++;
+    g->sum += gpa;
+}
+
+GroupStats *courseGroup(GroupTable *t, const char *course) {
+    if ((t->used + 1) * 2 > t->capacity) {
+        GroupTable grown = { calloc(t->capacity ? t->capacity * 2 : 64, sizeof(GroupStats)),
+                             t->capacity ? t->capacity * 2 : 64, 0 };
+        if (!grown.groups) return NULL;
+        for (int i = 0; i < t->capacity; i++)
+            if (t->groups[i].count)
+                *courseGroup(&grown, t->groups[i].key) = t->groups[i];
+        free(t->groups);
+        *t = grown;
+    }
+
+    uint32_t h = 2166136261u;
+    for (const char *c = course; *c; c++)
+        h = (h ^ foldChar(*c)) * 16777619u;
+    for (h &= t->capacity - 1; t->groups[h].count; h = (h + 1) & (t->capacity - 1))
+        if (strcasecmp(t->groups[h].key, course) == 0)
+            return &t->groups[h];
+
+    GroupStats *g = &t->groups[h];
+    snprintf(g->key, sizeof(g->key), "%s", course);
+    t->used++;
+    return g;
+}
+
+int compareGroups(const void *a, const void *b) {
+    return strcasecmp(((const GroupStats *)a)->key, ((const GroupStats *)b)->key);
+}
+
+void printGroup(const char *label, const GroupStats *g) {
+    printf("%-20s %7d  avg %6.2f  low %6.2f  high %6.2f\n",
+           label, g->count, g->sum / g->count, g->min, g->max);
+}
+
+// Everything comes from one pass over the roster: overall and grouped
+// (per course, per age band) aggregates, a 0.1-wide GPA histogram, and
+// a heap copy of the GPAs for the median and percentiles, which are
+// found by selection instead of sorting.
+void computeStatistics() {
+    int bins[STATS_BINS + 1] = {0};
+    GroupStats ageBands[AGE_BANDS];
+    GroupTable courses = {0};
+    GroupStats all = {0};
+    memset(ageBands, 0, sizeof(ageBands));
+
+    pthread_mutex_lock(&storeLock);
+    if (studentCount == 0) {
+        pthread_mutex_unlock(&storeLock);
+        return;
+    }
+
+    float *gp = malloc(studentCount * sizeof(float));
+    int n = 0, oom = gp == NULL;
+    for (int i = 0; i < slotCount && !oom; i++) {
+        const Student *s = &students[i];
+        if (!isLive(s)) continue;
+        float g = s->gpa;
+        gp[n++] = g;
+        groupAdd(&all, g);
+
+        int band = s->age < 0 ? 0 : s->age / AGE_BAND_YEARS;
+        groupAdd(&ageBands[band < AGE_BANDS ? band : AGE_BANDS - 1], g);
+
+        GroupStats *course = courseGroup(&courses, s->course);
+        if (!course) oom = 1;
+        else groupAdd(course, g);
+
+        int bin = (int)(g * 10.0f);
+        bins[bin < 0 ? 0 : bin > STATS_BINS ? STATS_BINS : bin]++;
+    }
+    pthread_mutex_unlock(&storeLock);
+
+    if (oom) {
+        printf("Out of memory.\n");
+        free(gp);
+        free(courses.groups);
+        return;
+    }
+
+    // percentiles by rank (the median is the (n/2)-th smallest); each
+    // selection only searches the part above the previous one
+    static const int pct[] = { 10, 25, 50, 75, 90 };
+    float at[5];
+    int from = 0;
+    for (int i = 0; i < 5; i++) {
+        int k = (int)((long long)pct[i] * n / 100);
+        if (k > n - 1) k = n - 1;
+        selectNth(gp + from, n - from, k - from);
+        at[i] = gp[k];
+        from = k;
+    }
+    free(gp);
 
     printf("\n--- STATISTICS ---\n");
-    printf("Class Average GPA: %.2f\n", avg);
-    printf("Median GPA: %.2f\n", median);
-    printf("Highest GPA: %.2f\n", max);
-    printf("Lowest GPA: %.2f\n", min);
+    printf("Class Average GPA: %.2f\n", all.sum / n);
+    printf("Median GPA: %.2f\n", at[2]);
+    printf("Highest GPA: %.2f\n", all.max);
+    printf("Lowest GPA: %.2f\n", all.min);
+    printf("Percentiles: 10th %.2f, 25th %.2f, 75th %.2f, 90th %.2f\n",
+           at[0], at[1], at[3], at[4]);
+
+    // ten buckets of (near) equal width from the lowest to the highest
+    // GPA, made by merging histogram bins, each with the running share
+    // of students; a span of fewer than ten bins gets one bucket per bin
+    int lo = (int)(all.min * 10.0f), hi = (int)(all.max * 10.0f);
+    lo = lo < 0 ? 0 : lo > STATS_BINS ? STATS_BINS : lo;
+    hi = hi < lo ? lo : hi > STATS_BINS ? STATS_BINS : hi;
+    int span = hi - lo + 1, buckets = span < 10 ? span : 10, largest = 0, below = 0;
+    int bucket[10] = {0}, first[11];
+    for (int k = 0; k <= buckets; k++) first[k] = lo + k * span / buckets;   // first[buckets] == hi + 1
+    for (int k = 0; k < buckets; k++) {
+        for (int i = first[k]; i < first[k + 1]; i++) bucket[k] += bins[i];
+        if (bucket[k] > largest) largest = bucket[k];
+    }
+    printf("\n--- GPA DISTRIBUTION ---\n");
+    for (int k = 0; k < buckets; k++) {
+        below += bucket[k];
+        printf("%6.1f - %6.1f  %7d  %5.1f%%  %.*s\n",
+               first[k] / 10.0, (first[k + 1] - 1) / 10.0, bucket[k], 100.0 * below / n,
+               (int)((long long)bucket[k] * 40 / largest), "########################################");
+    }
+
+    printf("\n--- BY COURSE ---\n");
+    int used = 0;
+    for (int i = 0; i < courses.capacity; i++)
+        if (courses.groups[i].count)
+            courses.groups[used++] = courses.groups[i];
+    qsort(courses.groups, used, sizeof(GroupStats), compareGroups);
+    for (int i = 0; i < used; i++)
+        printGroup(courses.groups[i].key[0] ? courses.groups[i].key : "(none)", &courses.groups[i]);
+    free(courses.groups);
+
+    printf("\n--- BY AGE ---\n");
+    for (int b = 0; b < AGE_BANDS; b++) {
+        if (!ageBands[b].count) continue;
+        char label[20];
+        if (b == AGE_BANDS - 1)
+            snprintf(label, sizeof(label), "%d+", b * AGE_BAND_YEARS);
+        else
+            snprintf(label, sizeof(label), "%d-%d", b * AGE_BAND_YEARS, (b + 1) * AGE_BAND_YEARS - 1);
+        printGroup(label, &ageBands[b]);
+    }
 }
 
 // MAIN MENU
@@ -259,9 +1454,10 @@ int main() {
         printf("2. Display Students\n");
         printf("3. Update Student\n");
         printf("4. Delete Student\n");
-        printf("5. Search Student by name\n");
-        printf("6. Statistics (Avg, Median, High/Low)\n");
+        printf("5. Search Student by name or course\n");
+        printf("6. Statistics (Avg, Median, High/Low, by course and age)\n");
         printf("7. Exit\n");
+        printf("8. Bulk update from file\n");
         printf("Enter choice: ");
 
         if (scanf("%d", &choice) != 1) {
@@ -277,12 +1473,14 @@ int main() {
             case 4: deleteStudent(); break;
             case 5: search(); break;
             case 6: computeStatistics(); break;
-            case 7: saveToFile(); printf("Exiting...\n"); break;
+            case 7: printf("Exiting...\n"); break;   // every change is already on disk
+            case 8: bulkUpdate(); break;
             default: printf("Invalid choice!\n");
         }
 
     } while (choice != 7);
 
+    closeStore();
     free(students);
     return 0;
 }
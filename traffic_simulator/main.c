@@ -1,7 +1,18 @@
+#define _GNU_SOURCE   /* pthread barriers, pread, posix_memalign */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <errno.h>
 #include <unistd.h>
 #include <time.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /* ============================
    Traffic Light States
@@ -13,223 +24,2841 @@ typedef enum {
 } LightState;
 
 /* ============================
-   Traffic Lane Structure
+   Signal Scheduler
    ============================ */
+/*
+ * Hashed timer wheel keyed on each lane's next transition time. Slot
+ * (t % WHEEL_SLOTS) holds an intrusive list of lanes due at t (or a
+ * whole number of wheel turns later), so a tick only visits lanes whose
+ * timers actually expire.
+ */
+#define WHEEL_SLOTS 256
+
 typedef struct {
-    int laneID;
-    int vehicleCount;
-    int vehiclesProcessed;
-    int greenTime;
-    int yellowTime;
-    int redTime;
-    LightState state;
-    time_t lastUpdate;
-} Lane;
+    int slot[WHEEL_SLOTS];  /* first lane due in each slot, -1 = empty */
+    time_t lastTick;        /* last second already processed */
+} TimerWheel;
+
+/* ============================
+   Vehicles and Vehicle Pool
+   ============================ */
+/*
+ * Every vehicle is a small record. Each lane queues its vehicles in a
+ * chain of fixed-size chunks used as a ring: vehicles are pushed at the
+ * tail chunk and popped from the head chunk, and emptied chunks go back
+ * to the pool's free list. Chunks come from one geometrically grown
+ * array per partition and are addressed by index, so millions of
+ * vehicles cost no per-vehicle malloc.
+ */
+typedef struct {
+    int64_t arrivalTick;   /* when the vehicle joined its current lane */
+    int32_t origin;        /* intersection where it entered the network */
+    int32_t destination;   /* intersection it turns towards, -1 = leaves */
+} Vehicle;
+
+#define CHUNK_VEHICLES 32
+
+typedef struct {
+    Vehicle v[CHUNK_VEHICLES];
+} VehicleChunk;
+
+typedef struct {
+    VehicleChunk *chunks;
+    int *next;             /* next chunk in a lane queue or the free list */
+    int capacity;
+    int used;              /* chunks handed out at least once */
+    int freeList;
+    int inUse;
+    int borrowed;          /* chunks/next point into a snapshot mapping */
+} VehiclePool;
+
+/* Vehicles discharged per second of green */
+#define SATURATION_FLOW 2
+
+/* ============================
+   Partitions and Hand-off
+   ============================ */
+/*
+ * Each partition owns a contiguous range of intersections (and so of
+ * lanes) together with its own timer wheel and random stream. Worker
+ * threads advance whole partitions, so results depend only on the
+ * partition count, never on how many threads share the work.
+ */
+typedef struct {
+    uint64_t state;
+} Rng;
+
+/* A vehicle crossing into a lane owned by another partition */
+typedef struct {
+    int lane;
+    Vehicle vehicle;
+} Handoff;
+
+/*
+ * Single-producer/single-consumer ring between two partitions. The
+ * producer pushes while signals update; the consumer drains it at the
+ * start of the next tick, after the barrier. If the ring fills up the
+ * producer spills into a private overflow array, which the consumer
+ * also reads after the barrier.
+ */
+typedef struct {
+    _Atomic unsigned head;
+    char pad[60];
+    _Atomic unsigned tail;
+    unsigned mask;
+    Handoff *ring;
+    Handoff *spill;
+    int spillCount;
+    int spillCap;
+    int source;
+} HandoffQueue;
+
+/*
+ * Arrivals from outside the network draw from their own stream, so the
+ * arrival trace for a seed is the same whichever signal controller runs.
+ */
+typedef struct {
+    int firstIntersection, lastIntersection;  /* [first, last) */
+    int firstLane, lastLane;
+    int inboxStart, inboxEnd;   /* queues into this partition, by source */
+    Rng rng;
+    Rng arrivalRng;
+    TimerWheel wheel;
+    VehiclePool pool;
+    int64_t queued;             /* vehicles waiting in the partition */
+    int64_t queueIntegral;      /* queued, summed once per tick */
+    int64_t ticks;
+} Partition;
+
+struct SignalController;
+
+/* ============================
+   Traffic Network Structure
+   ============================ */
+/*
+ * A network is a set of intersections, each owning a contiguous range
+ * of lanes. A lane is either an entry lane (vehicles arrive from outside
+ * the network) or the end of a road from a neighbouring intersection.
+ *
+ * Lane state is stored as struct-of-arrays: the per-tick update walks
+ * each array front to back instead of hopping across Lane structs.
+ * Every array is carved out of one allocation (arena).
+ */
+typedef struct {
+    int intersectionCount;
+    int laneCount;
+
+    /* topology */
+    int *laneStart;        /* lanes of k: laneStart[k] .. laneStart[k+1]-1 */
+    int *outStart;         /* roads leaving k: outStart[k] .. outStart[k+1]-1 */
+    int *outLane;          /* lane at the neighbour each road feeds */
+    int *laneIntersection; /* owning intersection of each lane */
+    int *upstream;         /* intersection feeding a lane, -1 = entry lane */
+
+    /* per-intersection signal state */
+    int *greenHolder;      /* lane currently GREEN, -1 = none */
+    int *waitHead;         /* lanes whose red expired while another held green */
+    int *waitTail;
+
+    /* per-lane state */
+    unsigned char *state;
+    int *vehicleCount;
+    int *vehiclesProcessed;
+    int *queueHead;        /* chunk holding the oldest vehicle, -1 = empty */
+    int *queueTail;        /* chunk receiving new vehicles */
+    int *headPos;          /* next vehicle to leave, within queueHead */
+    int *tailPos;          /* vehicles stored in queueTail */
+    int64_t *waitTotal;    /* summed wait of processed vehicles, in headways */
+    int *waitMax;          /* longest single wait, in headways */
+    int64_t *greenSeconds; /* total time spent GREEN */
+    int *arrivalsSince;    /* vehicles joined since rateSince */
+    time_t *rateSince;
+    float *arrivalRate;    /* EWMA of vehicles per second */
+    int *greenTime;
+    int *yellowTime;
+    int *redTime;
+    time_t *lastUpdate;
+    time_t *due;           /* next scheduled transition */
+    int *nextTimer;        /* next lane in the same wheel slot */
+    int *nextWaiting;      /* next lane in the intersection's wait queue */
+    int *outQueue;         /* hand-off queue of each road, -1 = same partition */
+
+    void *arena;
+    void *mapping;         /* snapshot the arena lives in, NULL = malloc'd */
+    size_t mappingSize;
+
+    Partition *partitions;
+    int partitionCount;
+    HandoffQueue *queues;  /* grouped by destination partition */
+    int queueCount;
+
+    const struct SignalController *controller;
+    struct Telemetry *telemetry;  /* live counters for outside readers, NULL = off */
+} Network;
+
+/* Road read from a network description, before lanes are numbered */
+typedef struct {
+    int from;
+    int to;
+} Road;
+
+#define MAX_LINE 256
+#define MAX_LISTED_LANES 32
+
+#define LOG_FILE "traffic_log.bin"
+#define LOG_TEXT_FILE "traffic_log.txt"
+#define LOG_MAGIC "TLOG"
+#define LOG_VERSION 1
+#define LOG_BUFFER_RECORDS 65536
+
+
+/* ============================
+   Simulation Clock
+   ============================ */
+/*
+ * Interactive runs follow the wall clock and sleep between ticks.
+ * Headless runs use a virtual clock that is advanced by hand, so a
+ * whole day of traffic can be replayed without waiting for it.
+ */
+typedef struct {
+    int isVirtual;
+    time_t now;
+} SimClock;
+
+time_t clockNow(const SimClock *clk) {
+    return clk->isVirtual ? clk->now : time(NULL);
+}
+
+void clockAdvance(SimClock *clk, int seconds) {
+    if (clk->isVirtual)
+        clk->now += seconds;
+    else
+        sleep(seconds);
+}
+
+
+double monotonicSeconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+const char *stateName(unsigned char state) {
+    return (state == GREEN)  ? "GREEN"  :
+           (state == YELLOW) ? "YELLOW" : "RED";
+}
+
+
+/* ============================
+   Binary Traffic Log
+   ============================ */
+/*
+ * The log is a small header followed by one fixed-size record per lane
+ * per tick. Records are collected in large buffers that a background
+ * thread appends to the file, so logging a tick costs a pass over the
+ * lane arrays rather than an fopen/fprintf/fclose.
+ */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t reserved;
+} LogHeader;
+
+typedef struct {
+    uint32_t tick;
+    int32_t laneID;
+    int64_t timestamp;
+    int32_t waiting;
+    int32_t processed;
+    uint16_t greenTime;
+    uint16_t yellowTime;
+    uint16_t redTime;
+    uint8_t state;
+    uint8_t reserved;
+} LogRecord;
+
+_Static_assert(sizeof(LogRecord) == 32, "log records must stay 32 bytes");
+
+typedef struct {
+    int fd;
+    LogRecord *buffers[2];
+    int active;            /* buffer being filled by the simulation */
+    int fill;
+    int pendingBuffer;     /* buffer handed to the writer thread */
+    int pendingCount;      /* 0 = writer idle */
+    int stop;
+    int failed;
+    long long bytesWritten;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} LogWriter;
+
+static int writeAll(int fd, const void *data, size_t bytes) {
+    const char *p = data;
+    while (bytes > 0) {
+        ssize_t n = write(fd, p, bytes);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        p += n;
+        bytes -= (size_t)n;
+    }
+    return 0;
+}
+
+static void *logWriterThread(void *arg) {
+    LogWriter *lw = arg;
+
+    pthread_mutex_lock(&lw->lock);
+    while (1) {
+        while (lw->pendingCount == 0 && !lw->stop)
+            pthread_cond_wait(&lw->cond, &lw->lock);
+        if (lw->pendingCount == 0)
+            break;
+
+        int buffer = lw->pendingBuffer;
+        size_t bytes = (size_t)lw->pendingCount * sizeof(LogRecord);
+        pthread_mutex_unlock(&lw->lock);
+
+        int rc = writeAll(lw->fd, lw->buffers[buffer], bytes);
+
+        pthread_mutex_lock(&lw->lock);
+        if (rc != 0)
+            lw->failed = 1;
+        else
+            lw->bytesWritten += (long long)bytes;
+        lw->pendingCount = 0;
+        pthread_cond_broadcast(&lw->cond);
+    }
+    pthread_mutex_unlock(&lw->lock);
+    return NULL;
+}
+
+/* Hands the active buffer to the writer thread, waiting if it is busy */
+static void logSubmit(LogWriter *lw) {
+    if (lw->fill == 0)
+        return;
+
+    pthread_mutex_lock(&lw->lock);
+    while (lw->pendingCount > 0)
+        pthread_cond_wait(&lw->cond, &lw->lock);
+    lw->pendingBuffer = lw->active;
+    lw->pendingCount = lw->fill;
+    pthread_cond_broadcast(&lw->cond);
+    pthread_mutex_unlock(&lw->lock);
+
+    lw->active ^= 1;
+    lw->fill = 0;
+}
+
+/*
+ * Opens the log for appending, writing the header if the file is new
+ * and checking it otherwise. Returns 0 on success.
+ */
+int logOpen(LogWriter *lw, const char *filename) {
+    memset(lw, 0, sizeof(*lw));
+
+    lw->fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (lw->fd < 0) {
+        printf("ERROR: Unable to open log file!\n");
+        return -1;
+    }
+
+    LogHeader header;
+    if (lseek(lw->fd, 0, SEEK_END) == 0) {
+        memcpy(header.magic, LOG_MAGIC, 4);
+        header.version = LOG_VERSION;
+        header.recordSize = sizeof(LogRecord);
+        header.reserved = 0;
+        if (writeAll(lw->fd, &header, sizeof(header)) != 0) {
+            printf("ERROR: Unable to write log header!\n");
+            close(lw->fd);
+            return -1;
+        }
+    } else if (pread(lw->fd, &header, sizeof(header), 0) != sizeof(header) ||
+               memcmp(header.magic, LOG_MAGIC, 4) != 0 ||
+               header.version != LOG_VERSION ||
+               header.recordSize != sizeof(LogRecord)) {
+        printf("ERROR: %s is not a traffic log of this version!\n", filename);
+        close(lw->fd);
+        return -1;
+    }
+
+    lw->buffers[0] = malloc(LOG_BUFFER_RECORDS * sizeof(LogRecord));
+    lw->buffers[1] = malloc(LOG_BUFFER_RECORDS * sizeof(LogRecord));
+    if (!lw->buffers[0] || !lw->buffers[1]) {
+        printf("ERROR: Unable to allocate log buffers!\n");
+        free(lw->buffers[0]);
+        free(lw->buffers[1]);
+        close(lw->fd);
+        return -1;
+    }
+
+    pthread_mutex_init(&lw->lock, NULL);
+    pthread_cond_init(&lw->cond, NULL);
+    if (pthread_create(&lw->thread, NULL, logWriterThread, lw) != 0) {
+        printf("ERROR: Unable to start log writer!\n");
+        pthread_mutex_destroy(&lw->lock);
+        pthread_cond_destroy(&lw->cond);
+        free(lw->buffers[0]);
+        free(lw->buffers[1]);
+        close(lw->fd);
+        return -1;
+    }
+    return 0;
+}
+
+/* Flushes everything still buffered and stops the writer thread */
+void logClose(LogWriter *lw) {
+    logSubmit(lw);
+
+    pthread_mutex_lock(&lw->lock);
+    lw->stop = 1;
+    pthread_cond_broadcast(&lw->cond);
+    pthread_mutex_unlock(&lw->lock);
+    pthread_join(lw->thread, NULL);
+
+    if (lw->failed)
+        printf("ERROR: Some log records could not be written!\n");
+
+    pthread_mutex_destroy(&lw->lock);
+    pthread_cond_destroy(&lw->cond);
+    free(lw->buffers[0]);
+    free(lw->buffers[1]);
+    close(lw->fd);
+}
+
+void logTick(LogWriter *lw, const Network *net, long tick, time_t now) {
+    for (int i = 0; i < net->laneCount; i++) {
+        if (lw->fill == LOG_BUFFER_RECORDS)
+            logSubmit(lw);
+
+        LogRecord *rec = &lw->buffers[lw->active][lw->fill++];
+        rec->tick = (uint32_t)tick;
+        rec->laneID = i;
+        rec->timestamp = (int64_t)now;
+        rec->waiting = net->vehicleCount[i];
+        rec->processed = net->vehiclesProcessed[i];
+        rec->greenTime = (uint16_t)net->greenTime[i];
+        rec->yellowTime = (uint16_t)net->yellowTime[i];
+        rec->redTime = (uint16_t)net->redTime[i];
+        rec->state = net->state[i];
+        rec->reserved = 0;
+    }
+}
+
+/*
+ * Converts a binary log back into the text format the simulator used
+ * to write, one "Cycle" block per tick.
+ */
+int dumpLog(const char *filename, FILE *out) {
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        printf("ERROR: Unable to open log file %s!\n", filename);
+        return -1;
+    }
+
+    LogHeader header;
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, LOG_MAGIC, 4) != 0 ||
+        header.version != LOG_VERSION ||
+        header.recordSize != sizeof(LogRecord)) {
+        printf("ERROR: %s is not a traffic log of this version!\n", filename);
+        fclose(fp);
+        return -1;
+    }
+
+    LogRecord *recs = malloc(4096 * sizeof(LogRecord));
+    if (!recs) {
+        printf("ERROR: Unable to allocate read buffer!\n");
+        fclose(fp);
+        return -1;
+    }
+
+    int first = 1;
+    int64_t lastTick = -1, lastStamp = 0;
+    size_t n;
+    while ((n = fread(recs, sizeof(LogRecord), 4096, fp)) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            const LogRecord *r = &recs[i];
+
+            /* a new cycle starts whenever the tick or timestamp changes */
+            if (first || r->tick != lastTick || r->timestamp != lastStamp) {
+                if (!first)
+                    fprintf(out, "\n");
+                fprintf(out, "===== Cycle %u (%lld) =====\n",
+                        r->tick, (long long)r->timestamp);
+                lastTick = r->tick;
+                lastStamp = r->timestamp;
+                first = 0;
+            }
+
+            fprintf(out,
+                    "Lane %d | State: %-6s | Waiting: %d | Processed: %d | "
+                    "G=%ds Y=%ds R=%ds\n",
+                    r->laneID,
+                    stateName(r->state),
+                    r->waiting,
+                    r->processed,
+                    r->greenTime,
+                    r->yellowTime,
+                    r->redTime);
+        }
+    }
+    if (!first)
+        fprintf(out, "\n");
+
+    free(recs);
+    fclose(fp);
+    return 0;
+}
+
+/* Menu action: writes the text form of the binary log next to it */
+void exportLog(void) {
+    FILE *out = fopen(LOG_TEXT_FILE, "w");
+    if (!out) {
+        printf("ERROR: Unable to create %s!\n", LOG_TEXT_FILE);
+        return;
+    }
+    int rc = dumpLog(LOG_FILE, out);
+    fclose(out);
+    if (rc == 0)
+        printf("Log exported to %s\n", LOG_TEXT_FILE);
+}
+
+
+/* ============================
+   Network Construction
+   ============================ */
+/*
+ * Hands out 64-byte aligned slices of the arena. With base == NULL it
+ * only advances the offset, which is how the arena size is measured.
+ */
+static void *carve(char *base, size_t *offset, size_t bytes) {
+    void *p = base ? base + *offset : NULL;
+    *offset += (bytes + 63) & ~(size_t)63;
+    return p;
+}
+
+static size_t layoutNetwork(Network *net, char *base, int roadCount) {
+    size_t n = (size_t)net->laneCount;
+    size_t k1 = (size_t)net->intersectionCount + 1;
+    size_t off = 0;
+
+    net->laneStart         = carve(base, &off, k1 * sizeof(int));
+    net->outStart          = carve(base, &off, k1 * sizeof(int));
+    net->greenHolder       = carve(base, &off, k1 * sizeof(int));
+    net->waitHead          = carve(base, &off, k1 * sizeof(int));
+    net->waitTail          = carve(base, &off, k1 * sizeof(int));
+    net->outLane           = carve(base, &off, (size_t)roadCount * sizeof(int));
+    net->outQueue          = carve(base, &off, (size_t)roadCount * sizeof(int));
+    net->laneIntersection  = carve(base, &off, n * sizeof(int));
+    net->upstream          = carve(base, &off, n * sizeof(int));
+    net->state             = carve(base, &off, n);
+    net->vehicleCount      = carve(base, &off, n * sizeof(int));
+    net->vehiclesProcessed = carve(base, &off, n * sizeof(int));
+    net->queueHead         = carve(base, &off, n * sizeof(int));
+    net->queueTail         = carve(base, &off, n * sizeof(int));
+    net->headPos           = carve(base, &off, n * sizeof(int));
+    net->tailPos           = carve(base, &off, n * sizeof(int));
+    net->waitTotal         = carve(base, &off, n * sizeof(int64_t));
+    net->waitMax           = carve(base, &off, n * sizeof(int));
+    net->greenSeconds      = carve(base, &off, n * sizeof(int64_t));
+    net->arrivalsSince     = carve(base, &off, n * sizeof(int));
+    net->rateSince         = carve(base, &off, n * sizeof(time_t));
+    net->arrivalRate       = carve(base, &off, n * sizeof(float));
+    net->greenTime         = carve(base, &off, n * sizeof(int));
+    net->yellowTime        = carve(base, &off, n * sizeof(int));
+    net->redTime           = carve(base, &off, n * sizeof(int));
+    net->lastUpdate        = carve(base, &off, n * sizeof(time_t));
+    net->due               = carve(base, &off, n * sizeof(time_t));
+    net->nextTimer         = carve(base, &off, n * sizeof(int));
+    net->nextWaiting       = carve(base, &off, n * sizeof(int));
+    return off;
+}
+
+/*
+ * Builds a network from per-intersection entry-lane counts and a list
+ * of roads. Lanes of intersection k are its entry lanes followed by one
+ * lane per road ending at k, in road order. Returns 0 on success.
+ */
+int buildNetwork(Network *net, int intersectionCount, const int *entryLanes,
+                 const Road *roads, int roadCount) {
+    memset(net, 0, sizeof(*net));
+
+    long laneCount = 0;
+    for (int k = 0; k < intersectionCount; k++)
+        laneCount += entryLanes[k];
+    laneCount += roadCount;
+
+    if (intersectionCount <= 0 || laneCount <= 0 || laneCount > 100000000) {
+        printf("ERROR: Network must have between 1 and 100000000 lanes!\n");
+        return -1;
+    }
+
+    size_t k1 = (size_t)intersectionCount + 1;
+
+    net->intersectionCount = intersectionCount;
+    net->laneCount = (int)laneCount;
+
+    size_t bytes = layoutNetwork(net, NULL, roadCount);
+    if (posix_memalign(&net->arena, 64, bytes) != 0) {
+        net->arena = NULL;
+        printf("ERROR: Unable to allocate network!\n");
+        return -1;
+    }
+    memset(net->arena, 0, bytes);
+    layoutNetwork(net, net->arena, roadCount);
+
+    /* lanes: entry lanes first, then one lane per incoming road */
+    int *roadsInto = calloc(k1, sizeof(int));
+    if (!roadsInto) {
+        free(net->arena);
+        net->arena = NULL;
+        printf("ERROR: Unable to allocate network!\n");
+        return -1;
+    }
+    for (int r = 0; r < roadCount; r++)
+        roadsInto[roads[r].to]++;
+
+    int lane = 0;
+    for (int k = 0; k < intersectionCount; k++) {
+        net->laneStart[k] = lane;
+        for (int e = 0; e < entryLanes[k]; e++) {
+            net->laneIntersection[lane] = k;
+            net->upstream[lane] = -1;
+            lane++;
+        }
+        lane += roadsInto[k];
+    }
+    net->laneStart[intersectionCount] = lane;
+
+    /* roads: reuse roadsInto as the next free road lane of each intersection */
+    for (int k = 0; k < intersectionCount; k++)
+        roadsInto[k] = net->laneStart[k] + entryLanes[k];
+
+    for (int r = 0; r < roadCount; r++)
+        net->outStart[roads[r].from + 1]++;
+    for (int k = 0; k < intersectionCount; k++)
+        net->outStart[k + 1] += net->outStart[k];
+
+    int *outFill = malloc(k1 * sizeof(int));
+    if (!outFill) {
+        free(roadsInto);
+        free(net->arena);
+        net->arena = NULL;
+        printf("ERROR: Unable to allocate network!\n");
+        return -1;
+    }
+    memcpy(outFill, net->outStart, k1 * sizeof(int));
+
+    for (int r = 0; r < roadCount; r++) {
+        int l = roadsInto[roads[r].to]++;
+        net->laneIntersection[l] = roads[r].to;
+        net->upstream[l] = roads[r].from;
+        net->outLane[outFill[roads[r].from]++] = l;
+    }
+
+    free(outFill);
+    free(roadsInto);
+    return 0;
+}
+
+void freeNetwork(Network *net) {
+    for (int q = 0; q < net->queueCount; q++) {
+        free(net->queues[q].ring);
+        free(net->queues[q].spill);
+    }
+    free(net->queues);
+    for (int p = 0; p < net->partitionCount; p++) {
+        if (net->partitions[p].pool.borrowed)
+            continue;
+        free(net->partitions[p].pool.chunks);
+        free(net->partitions[p].pool.next);
+    }
+    free(net->partitions);
+    if (net->mapping)
+        munmap(net->mapping, net->mappingSize);
+    else
+        free(net->arena);
+    memset(net, 0, sizeof(*net));
+}
+
+/*
+ * Default network: one intersection with two competing entry lanes,
+ * which is what the simulator has always modelled.
+ */
+int defaultNetwork(Network *net) {
+    int entry = 2;
+    return buildNetwork(net, 1, &entry, NULL, 0);
+}
+
+/*
+ * City grid of width x height intersections. Neighbours are joined by a
+ * road in each direction; intersections on the edge get one entry lane
+ * for every side that faces outside the grid.
+ */
+int gridNetwork(Network *net, int width, int height) {
+    if (width <= 0 || height <= 0 || (long)width * height > 25000000) {
+        printf("ERROR: Invalid grid size!\n");
+        return -1;
+    }
+
+    int count = width * height;
+    int *entry = malloc((size_t)count * sizeof(int));
+    Road *roads = malloc((size_t)count * 4 * sizeof(Road));
+    if (!entry || !roads) {
+        free(entry);
+        free(roads);
+        printf("ERROR: Unable to allocate grid!\n");
+        return -1;
+    }
+
+    int roadCount = 0;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int k = y * width + x;
+            entry[k] = (x == 0) + (x == width - 1) + (y == 0) + (y == height - 1);
+            if (x > 0)          roads[roadCount++] = (Road){ k - 1, k };
+            if (x < width - 1)  roads[roadCount++] = (Road){ k + 1, k };
+            if (y > 0)          roads[roadCount++] = (Road){ k - width, k };
+            if (y < height - 1) roads[roadCount++] = (Road){ k + width, k };
+        }
+    }
+
+    int rc = buildNetwork(net, count, entry, roads, roadCount);
+    free(entry);
+    free(roads);
+    return rc;
+}
+
+/*
+ * Network description file, one directive per line ('#' starts a comment):
+ *
+ *   intersection <id> <entry lanes>
+ *   road <from id> <to id>
+ *
+ * Intersection ids must be 0..n-1. Each road adds one lane at <to> that
+ * is fed by vehicles leaving <from>.
+ */
+int loadNetwork(Network *net, const char *filename) {
+    FILE *fp = fopen(filename, "r");
+    if (!fp) {
+        printf("ERROR: Unable to open network file %s!\n", filename);
+        return -1;
+    }
+
+    int *entry = NULL;
+    int intersectionCount = 0, entryCap = 0;
+    Road *roads = NULL;
+    int roadCount = 0, roadCap = 0;
+    char line[MAX_LINE];
+    int lineNo = 0, rc = -1;
+
+    while (fgets(line, sizeof(line), fp)) {
+        lineNo++;
+        line[strcspn(line, "#\n")] = 0;
+
+        char word[32];
+        int a, b;
+        if (sscanf(line, "%31s", word) != 1)
+            continue;
+
+        if (strcmp(word, "intersection") == 0 &&
+            sscanf(line, "%*s %d %d", &a, &b) == 2) {
+            if (a < 0 || b < 0) {
+                printf("ERROR: %s:%d: negative value\n", filename, lineNo);
+                goto done;
+            }
+            if (a >= entryCap) {
+                int cap = entryCap ? entryCap : 64;
+                while (cap <= a) cap *= 2;
+                int *grown = realloc(entry, (size_t)cap * sizeof(int));
+                if (!grown) {
+                    printf("ERROR: Out of memory reading %s\n", filename);
+                    goto done;
+                }
+                memset(grown + entryCap, -1, (size_t)(cap - entryCap) * sizeof(int));
+                entry = grown;
+                entryCap = cap;
+            }
+            entry[a] = b;
+            if (a + 1 > intersectionCount)
+                intersectionCount = a + 1;
+        } else if (strcmp(word, "road") == 0 &&
+                   sscanf(line, "%*s %d %d", &a, &b) == 2) {
+            if (roadCount == roadCap) {
+                int cap = roadCap ? roadCap * 2 : 256;
+                Road *grown = realloc(roads, (size_t)cap * sizeof(Road));
+                if (!grown) {
+                    printf("ERROR: Out of memory reading %s\n", filename);
+                    goto done;
+                }
+                roads = grown;
+                roadCap = cap;
+            }
+            roads[roadCount++] = (Road){ a, b };
+        } else {
+            printf("ERROR: %s:%d: unrecognised line\n", filename, lineNo);
+            goto done;
+        }
+    }
+
+    for (int k = 0; k < intersectionCount; k++) {
+        if (entry[k] < 0) {
+            printf("ERROR: %s: intersection %d is not declared\n", filename, k);
+            goto done;
+        }
+    }
+    for (int r = 0; r < roadCount; r++) {
+        if (roads[r].from < 0 || roads[r].from >= intersectionCount ||
+            roads[r].to < 0 || roads[r].to >= intersectionCount ||
+            roads[r].from == roads[r].to) {
+            printf("ERROR: %s: road %d -> %d joins unknown intersections\n",
+                   filename, roads[r].from, roads[r].to);
+            goto done;
+        }
+    }
+
+    rc = buildNetwork(net, intersectionCount, entry, roads, roadCount);
+
+done:
+    fclose(fp);
+    free(entry);
+    free(roads);
+    return rc;
+}
+
+
+/* ============================
+   Network Partitioning
+   ============================ */
+int lanePartition(const Network *net, int lane) {
+    int lo = 0, hi = net->partitionCount - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (net->partitions[mid].firstLane <= lane)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+/*
+ * Splits the network into up to `count` partitions of roughly equal
+ * lane counts and creates one hand-off queue for every ordered pair of
+ * partitions joined by at least one road.
+ */
+int partitionNetwork(Network *net, int count) {
+    if (count < 1)
+        count = 1;
+    if (count > net->intersectionCount)
+        count = net->intersectionCount;
+
+    Partition *parts = calloc((size_t)count, sizeof(Partition));
+    if (!parts) {
+        printf("ERROR: Unable to allocate partitions!\n");
+        return -1;
+    }
+
+    /* contiguous intersection ranges, balanced by lane count */
+    int k = 0;
+    for (int p = 0; p < count; p++) {
+        long target = (long)net->laneCount * (p + 1) / count;
+        parts[p].firstIntersection = k;
+        parts[p].firstLane = net->laneStart[k];
+        k++;
+        while (k < net->intersectionCount - (count - p - 1) &&
+               net->laneStart[k] < target)
+            k++;
+        if (p == count - 1)
+            k = net->intersectionCount;
+        parts[p].lastIntersection = k;
+        parts[p].lastLane = net->laneStart[k];
+    }
+
+    net->partitions = parts;
+    net->partitionCount = count;
+
+    /* roads crossing partitions, counted per (destination, source) pair */
+    size_t pairs = (size_t)count * count;
+    int *crossing = calloc(pairs, sizeof(int));
+    int *queueOf = malloc(pairs * sizeof(int));
+    if (!crossing || !queueOf) {
+        free(crossing);
+        free(queueOf);
+        printf("ERROR: Unable to allocate hand-off queues!\n");
+        return -1;
+    }
+
+    for (int p = 0; p < count; p++)
+        for (int i = parts[p].firstIntersection; i < parts[p].lastIntersection; i++)
+            for (int r = net->outStart[i]; r < net->outStart[i + 1]; r++) {
+                int d = lanePartition(net, net->outLane[r]);
+                if (d != p)
+                    crossing[(size_t)d * count + p]++;
+            }
+
+    int queueCount = 0;
+    for (size_t i = 0; i < pairs; i++)
+        queueCount += (crossing[i] > 0);
+
+    net->queues = calloc(queueCount ? (size_t)queueCount : 1, sizeof(HandoffQueue));
+    if (!net->queues) {
+        free(crossing);
+        free(queueOf);
+        printf("ERROR: Unable to allocate hand-off queues!\n");
+        return -1;
+    }
+
+    int q = 0;
+    for (int d = 0; d < count; d++) {
+        parts[d].inboxStart = q;
+        for (int src = 0; src < count; src++) {
+            size_t pair = (size_t)d * count + src;
+            queueOf[pair] = -1;
+            if (crossing[pair] == 0)
+                continue;
+
+            unsigned cap = 64;
+            while (cap < (unsigned)crossing[pair] * 16)
+                cap *= 2;
+
+            HandoffQueue *hq = &net->queues[q];
+            hq->ring = malloc(cap * sizeof(Handoff));
+            if (!hq->ring) {
+                net->queueCount = q;
+                free(crossing);
+                free(queueOf);
+                printf("ERROR: Unable to allocate hand-off queues!\n");
+                return -1;
+            }
+            hq->mask = cap - 1;
+            hq->source = src;
+            queueOf[pair] = q++;
+        }
+        parts[d].inboxEnd = q;
+    }
+    net->queueCount = q;
+
+    for (int p = 0; p < count; p++)
+        for (int i = parts[p].firstIntersection; i < parts[p].lastIntersection; i++)
+            for (int r = net->outStart[i]; r < net->outStart[i + 1]; r++) {
+                int d = lanePartition(net, net->outLane[r]);
+                net->outQueue[r] = (d == p) ? -1 : queueOf[(size_t)d * count + p];
+            }
+
+    free(crossing);
+    free(queueOf);
+    return 0;
+}
+
+
+/* ============================
+   Random Numbers
+   ============================ */
+/* splitmix64: tiny state, so every partition can carry its own stream */
+static inline uint64_t rngNext(Rng *rng) {
+    uint64_t z = (rng->state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* uniform integer in [0, n) */
+static inline int rngBelow(Rng *rng, int n) {
+    return (int)(((rngNext(rng) >> 32) * (uint64_t)n) >> 32);
+}
+
+
+/* ============================
+   Vehicle Queues
+   ============================ */
+int poolAlloc(VehiclePool *pool) {
+    int c = pool->freeList;
+    if (c >= 0) {
+        pool->freeList = pool->next[c];
+    } else {
+        if (pool->used == pool->capacity) {
+            int cap = pool->capacity ? pool->capacity * 2 : 64;
+            if (pool->borrowed) {
+                /* restored from a snapshot: move out of the mapping on first growth */
+                VehicleChunk *chunks = malloc((size_t)cap * sizeof(VehicleChunk));
+                int *next = malloc((size_t)cap * sizeof(int));
+                if (!chunks || !next) {
+                    free(chunks);
+                    free(next);
+                    return -1;
+                }
+                memcpy(chunks, pool->chunks, (size_t)pool->used * sizeof(VehicleChunk));
+                memcpy(next, pool->next, (size_t)pool->used * sizeof(int));
+                pool->chunks = chunks;
+                pool->next = next;
+                pool->borrowed = 0;
+            } else {
+                VehicleChunk *chunks = realloc(pool->chunks, (size_t)cap * sizeof(VehicleChunk));
+                if (!chunks)
+                    return -1;
+                pool->chunks = chunks;
+                int *next = realloc(pool->next, (size_t)cap * sizeof(int));
+                if (!next)
+                    return -1;
+                pool->next = next;
+            }
+            pool->capacity = cap;
+        }
+        c = pool->used++;
+    }
+    pool->next[c] = -1;
+    pool->inUse++;
+    return c;
+}
+
+void poolFree(VehiclePool *pool, int c) {
+    pool->next[c] = pool->freeList;
+    pool->freeList = c;
+    pool->inUse--;
+}
+
+int enqueueVehicle(Network *net, VehiclePool *pool, int lane, Vehicle v) {
+    int tail = net->queueTail[lane];
+
+    if (tail < 0 || net->tailPos[lane] == CHUNK_VEHICLES) {
+        int c = poolAlloc(pool);
+        if (c < 0) {
+            printf("ERROR: Vehicle pool exhausted!\n");
+            return -1;
+        }
+        if (tail < 0) {
+            net->queueHead[lane] = c;
+            net->headPos[lane] = 0;
+        } else {
+            pool->next[tail] = c;
+        }
+        net->queueTail[lane] = tail = c;
+        net->tailPos[lane] = 0;
+    }
+
+    pool->chunks[tail].v[net->tailPos[lane]++] = v;
+    net->vehicleCount[lane]++;
+    net->arrivalsSince[lane]++;
+    return 0;
+}
+
+/* Oldest queued vehicle; the lane must not be empty */
+const Vehicle *peekVehicle(const Network *net, const VehiclePool *pool, int lane) {
+    return &pool->chunks[net->queueHead[lane]].v[net->headPos[lane]];
+}
+
+void popVehicle(Network *net, VehiclePool *pool, int lane) {
+    int head = net->queueHead[lane];
+    int pos = ++net->headPos[lane];
+    net->vehicleCount[lane]--;
+
+    if (head == net->queueTail[lane] && pos == net->tailPos[lane]) {
+        poolFree(pool, head);
+        net->queueHead[lane] = net->queueTail[lane] = -1;
+    } else if (pos == CHUNK_VEHICLES) {
+        net->queueHead[lane] = pool->next[head];
+        net->headPos[lane] = 0;
+        poolFree(pool, head);
+    }
+}
+
+/*
+ * A vehicle joining a lane picks where it will turn once through the
+ * signal: one of the roads leaving the intersection or out of the
+ * network, chosen uniformly.
+ */
+void joinLane(Network *net, Partition *part, Rng *rng, int lane, Vehicle v) {
+    int k = net->laneIntersection[lane];
+    int first = net->outStart[k];
+    int choices = net->outStart[k + 1] - first;
+
+    v.destination = -1;
+    if (choices > 0) {
+        int pick = rngBelow(rng, choices + 1);
+        if (pick < choices)
+            v.destination = net->laneIntersection[net->outLane[first + pick]];
+    }
+    if (enqueueVehicle(net, &part->pool, lane, v) == 0)
+        part->queued++;
+}
+
+
+/* ============================
+   Initialize Lanes
+   ============================ */
+void scheduleLane(Network *net, Partition *part, int lane, time_t due);
+
+void initializeLanes(Network *net, time_t now, unsigned seed) {
+    for (int p = 0; p < net->partitionCount; p++) {
+        Partition *part = &net->partitions[p];
+        for (int s = 0; s < WHEEL_SLOTS; s++)
+            part->wheel.slot[s] = -1;
+        part->wheel.lastTick = now;
+        part->rng.state = ((uint64_t)seed << 32) ^ (0xD1B54A32D192ED03ULL * (p + 1));
+        part->arrivalRng.state = ~part->rng.state;
+        part->queued = 0;
+        part->queueIntegral = 0;
+        part->ticks = 0;
+        part->pool.used = 0;
+        part->pool.inUse = 0;
+        part->pool.freeList = -1;
+    }
+
+    for (int q = 0; q < net->queueCount; q++) {
+        atomic_store(&net->queues[q].head, 0);
+        atomic_store(&net->queues[q].tail, 0);
+        net->queues[q].spillCount = 0;
+    }
+
+    for (int k = 0; k < net->intersectionCount; k++) {
+        net->greenHolder[k] = -1;
+        net->waitHead[k] = -1;
+        net->waitTail[k] = -1;
+    }
+
+    for (int i = 0; i < net->laneCount; i++) {
+        Partition *part = &net->partitions[lanePartition(net, i)];
+
+        /* entry lanes start with a short queue, as the original two lanes did */
+        int vehicles = (net->upstream[i] < 0) ? 2 - (i % 2) : 0;
+
+        net->vehicleCount[i] = 0;
+        net->vehiclesProcessed[i] = 0;
+        net->queueHead[i] = net->queueTail[i] = -1;
+        net->headPos[i] = net->tailPos[i] = 0;
+        net->waitTotal[i] = 0;
+        net->waitMax[i] = 0;
+        net->greenSeconds[i] = 0;
+        net->arrivalsSince[i] = 0;
+        net->rateSince[i] = now;
+        net->arrivalRate[i] = 0.0f;
+        for (int v = 0; v < vehicles; v++)
+            joinLane(net, part, &part->arrivalRng, i,
+                     (Vehicle){ now, net->laneIntersection[i], -1 });
+
+        net->greenTime[i] = 2 + vehicles;
+        if (net->greenTime[i] > 5)
+            net->greenTime[i] = 5;
+
+        net->yellowTime[i] = 2;
+        net->redTime[i]    = 2;
+
+        net->state[i] = RED;
+        net->lastUpdate[i] = now;
+        net->nextWaiting[i] = -1;
+        scheduleLane(net, part, i, now + net->redTime[i]);
+    }
+}
+
+
+/* ============================
+   Vehicle Arrivals
+   ============================ */
+/*
+ * Pushes a vehicle onto a hand-off queue. Called only by the thread that
+ * owns the queue's source partition.
+ */
+void pushHandoff(HandoffQueue *hq, int lane, Vehicle v) {
+    unsigned tail = atomic_load_explicit(&hq->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&hq->head, memory_order_acquire);
+
+    if (tail - head <= hq->mask) {
+        hq->ring[tail & hq->mask] = (Handoff){ lane, v };
+        atomic_store_explicit(&hq->tail, tail + 1, memory_order_release);
+        return;
+    }
+
+    if (hq->spillCount == hq->spillCap) {
+        int cap = hq->spillCap ? hq->spillCap * 2 : 64;
+        Handoff *grown = realloc(hq->spill, (size_t)cap * sizeof(Handoff));
+        if (!grown) {
+            printf("ERROR: Hand-off overflow, vehicle dropped!\n");
+            return;
+        }
+        hq->spill = grown;
+        hq->spillCap = cap;
+    }
+    hq->spill[hq->spillCount++] = (Handoff){ lane, v };
+}
+
+/* Called only by the thread that owns the queue's destination partition */
+void drainHandoffs(Network *net, Partition *part, HandoffQueue *hq) {
+    unsigned head = atomic_load_explicit(&hq->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&hq->tail, memory_order_acquire);
+
+    for (; head != tail; head++) {
+        Handoff h = hq->ring[head & hq->mask];
+        joinLane(net, part, &part->rng, h.lane, h.vehicle);
+    }
+    atomic_store_explicit(&hq->head, head, memory_order_release);
+
+    for (int i = 0; i < hq->spillCount; i++)
+        joinLane(net, part, &part->rng, hq->spill[i].lane, hq->spill[i].vehicle);
+    hq->spillCount = 0;
+}
+
+/*
+ * Queues vehicles handed over from neighbouring partitions and adds
+ * random arrivals on the partition's entry lanes.
+ */
+void addArrivals(Network *net, Partition *part, time_t now) {
+    for (int q = part->inboxStart; q < part->inboxEnd; q++)
+        drainHandoffs(net, part, &net->queues[q]);
+
+    const int *upstream = net->upstream;
+
+    for (int i = part->firstLane; i < part->lastLane; i++) {
+        if (upstream[i] < 0 && (rngNext(&part->arrivalRng) & 1))
+            joinLane(net, part, &part->arrivalRng, i,
+                     (Vehicle){ now, net->laneIntersection[i], -1 });
+    }
+
+    part->queueIntegral += part->queued;
+    part->ticks++;
+}
+
+/*
+ * Releases the vehicles that got through a green phase ending at `end`.
+ * Queued vehicles leave one headway (1 / SATURATION_FLOW s) apart, but
+ * never before they arrived, so vehicles that joined during the green
+ * can still make it. Each one's wait is recorded, then it moves on to
+ * the lane it turned towards, arriving there a second after the phase.
+ */
+void dischargeLane(Network *net, Partition *part, int lane, time_t end) {
+    int k = net->laneIntersection[lane];
+    int64_t slot = (int64_t)net->lastUpdate[lane] * SATURATION_FLOW;
+    int64_t stop = (int64_t)end * SATURATION_FLOW;
+
+    net->greenSeconds[lane] += end - net->lastUpdate[lane];
+
+    while (net->vehicleCount[lane] > 0) {
+        Vehicle v = *peekVehicle(net, &part->pool, lane);
+        int64_t arrived = v.arrivalTick * SATURATION_FLOW;
+        int64_t leaves = (arrived > slot) ? arrived : slot;
+        if (leaves >= stop)
+            break;
+
+        popVehicle(net, &part->pool, lane);
+        part->queued--;
+        slot = leaves + 1;
+
+        int64_t wait = leaves - arrived;
+        net->waitTotal[lane] += wait;
+        if (wait > net->waitMax[lane])
+            net->waitMax[lane] = (int)wait;
+        net->vehiclesProcessed[lane]++;
+
+        if (v.destination < 0)
+            continue;
+
+        for (int r = net->outStart[k]; r < net->outStart[k + 1]; r++) {
+            int next = net->outLane[r];
+            if (net->laneIntersection[next] != v.destination)
+                continue;
+
+            v.arrivalTick = end + 1;
+            if (net->outQueue[r] < 0)
+                joinLane(net, part, &part->rng, next, v);
+            else
+                pushHandoff(&net->queues[net->outQueue[r]], next, v);
+            break;
+        }
+    }
+}
+
+
+/* ============================
+   Signal Controllers
+   ============================ */
+/*
+ * A controller decides how long a green phase lasts and which waiting
+ * lane gets green next. extendGreen (optional) is asked when a green
+ * timer runs out, after the vehicles so far have been released, and
+ * returns extra seconds of green or 0 to end the phase. pickNext
+ * (optional) chooses from the intersection's wait queue; without it the
+ * lane that has waited longest goes next.
+ *
+ * Controllers only read lanes of their own partition, so they stay
+ * race-free and deterministic when partitions run in parallel.
+ */
+typedef struct SignalController {
+    const char *name;
+    int (*greenTime)(const Network *net, int lane);
+    int (*extendGreen)(const Network *net, int lane);
+    int (*pickNext)(const Network *net, int intersection);
+} SignalController;
+
+#define MIN_GREEN 2
+#define MAX_GREEN 10
+#define FIXED_GREEN 4
+#define PRESSURE_SLOT 3
+#define EWMA_WEIGHT 0.3f
+
+static int clampGreen(int seconds) {
+    if (seconds < MIN_GREEN) return MIN_GREEN;
+    if (seconds > MAX_GREEN) return MAX_GREEN;
+    return seconds;
+}
+
+/* The original rule: 2s plus one per waiting vehicle, at most 5s */
+int queueGreen(const Network *net, int lane) {
+    int g = 2 + net->vehicleCount[lane];
+    return (g > 5) ? 5 : g;
+}
+
+/* Fixed-time plan: every phase gets the same green */
+int fixedGreen(const Network *net, int lane) {
+    (void)net;
+    (void)lane;
+    return FIXED_GREEN;
+}
+
+/* Actuated: minimum green, extended a second at a time while vehicles remain */
+int actuatedGreen(const Network *net, int lane) {
+    (void)net;
+    (void)lane;
+    return MIN_GREEN;
+}
+
+int actuatedExtend(const Network *net, int lane) {
+    if (net->vehicleCount[lane] == 0 || net->greenTime[lane] >= MAX_GREEN)
+        return 0;
+    return 1;
+}
+
+/*
+ * Max-pressure: green goes to the waiting lane whose queue most exceeds
+ * the average queue on the lanes it feeds, for one fixed slot. Lanes
+ * owned by another partition cannot be read mid-tick and count as empty.
+ */
+int pressureGreen(const Network *net, int lane) {
+    (void)net;
+    (void)lane;
+    return PRESSURE_SLOT;
+}
+
+static int lanePressure(const Network *net, int lane) {
+    int k = net->laneIntersection[lane];
+    int roads = net->outStart[k + 1] - net->outStart[k];
+    long downstream = 0;
+
+    for (int r = net->outStart[k]; r < net->outStart[k + 1]; r++)
+        if (net->outQueue[r] < 0)
+            downstream += net->vehicleCount[net->outLane[r]];
+
+    return net->vehicleCount[lane] - (roads ? (int)(downstream / roads) : 0);
+}
+
+int pressurePick(const Network *net, int intersection) {
+    int best = -1, bestPressure = 0;
+    for (int l = net->waitHead[intersection]; l >= 0; l = net->nextWaiting[l]) {
+        int p = lanePressure(net, l);
+        if (best < 0 || p > bestPressure) {
+            best = l;
+            bestPressure = p;
+        }
+    }
+    return best;
+}
+
+/*
+ * EWMA predictor: sizes the green to clear the current queue plus the
+ * vehicles expected to arrive meanwhile, from a smoothed arrival rate.
+ */
+int ewmaGreen(const Network *net, int lane) {
+    double rate = net->arrivalRate[lane];
+    if (rate >= SATURATION_FLOW)
+        return MAX_GREEN;
+    double seconds = net->vehicleCount[lane] / (SATURATION_FLOW - rate);
+    return clampGreen((int)(seconds + 0.999));
+}
+
+SignalController controllers[] = {
+    { "queue",        queueGreen,    NULL,           NULL },
+    { "fixed",        fixedGreen,    NULL,           NULL },
+    { "actuated",     actuatedGreen, actuatedExtend, NULL },
+    { "max-pressure", pressureGreen, NULL,           pressurePick },
+    { "ewma",         ewmaGreen,     NULL,           NULL },
+};
+
+int num_controllers = sizeof(controllers) / sizeof(controllers[0]);
+
+const SignalController *findController(const char *name) {
+    for (int i = 0; i < num_controllers; i++)
+        if (strcmp(controllers[i].name, name) == 0)
+            return &controllers[i];
+    return NULL;
+}
+
+
+/* ============================
+   Update Traffic Signals
+   ============================ */
+void scheduleLane(Network *net, Partition *part, int lane, time_t due) {
+    int s = (int)(due & (WHEEL_SLOTS - 1));
+    net->due[lane] = due;
+    net->nextTimer[lane] = part->wheel.slot[s];
+    part->wheel.slot[s] = lane;
+}
+
+/* Only used by emergency override, so a slot scan is fine */
+void unscheduleLane(Network *net, Partition *part, int lane) {
+    int *link = &part->wheel.slot[net->due[lane] & (WHEEL_SLOTS - 1)];
+    while (*link >= 0) {
+        if (*link == lane) {
+            *link = net->nextTimer[lane];
+            return;
+        }
+        link = &net->nextTimer[*link];
+    }
+}
+
+/*
+ * Turns a lane GREEN for as long as the controller decides. Vehicles are
+ * released when the phase ends. The lane's arrival rate estimate is
+ * refreshed here, once per cycle, rather than on every tick.
+ */
+void startGreen(Network *net, Partition *part, int lane, time_t now) {
+    time_t span = now - net->rateSince[lane];
+    if (span > 0) {
+        float rate = (float)net->arrivalsSince[lane] / (float)span;
+        net->arrivalRate[lane] += EWMA_WEIGHT * (rate - net->arrivalRate[lane]);
+        net->arrivalsSince[lane] = 0;
+        net->rateSince[lane] = now;
+    }
+
+    net->greenTime[lane] = net->controller->greenTime(net, lane);
+    if (net->greenTime[lane] < 1)
+        net->greenTime[lane] = 1;
+
+    net->state[lane] = GREEN;
+    net->lastUpdate[lane] = now;
+    net->greenHolder[net->laneIntersection[lane]] = lane;
+
+    scheduleLane(net, part, lane, now + net->greenTime[lane]);
+}
+
+/* Removes a lane from its intersection's wait queue */
+void takeWaiting(Network *net, int k, int lane) {
+    int prev = -1;
+    for (int l = net->waitHead[k]; l >= 0; prev = l, l = net->nextWaiting[l]) {
+        if (l != lane)
+            continue;
+        if (prev < 0)
+            net->waitHead[k] = net->nextWaiting[l];
+        else
+            net->nextWaiting[prev] = net->nextWaiting[l];
+        if (net->waitTail[k] == l)
+            net->waitTail[k] = prev;
+        net->nextWaiting[l] = -1;
+        return;
+    }
+}
+
+void expireLane(Network *net, Partition *part, int lane, time_t now) {
+    int k = net->laneIntersection[lane];
+
+    switch (net->state[lane]) {
+        case GREEN: {
+            const SignalController *ctl = net->controller;
+
+            dischargeLane(net, part, lane, now);
+            net->lastUpdate[lane] = now;
+
+            int extra = ctl->extendGreen ? ctl->extendGreen(net, lane) : 0;
+            if (extra > 0) {
+                net->greenTime[lane] += extra;
+                scheduleLane(net, part, lane, now + extra);
+                break;
+            }
+
+            net->state[lane] = YELLOW;
+            scheduleLane(net, part, lane, now + net->yellowTime[lane]);
+
+            /* hand green to the next waiting lane */
+            net->greenHolder[k] = -1;
+            if (net->waitHead[k] >= 0) {
+                int next = ctl->pickNext ? ctl->pickNext(net, k) : net->waitHead[k];
+                takeWaiting(net, k, next);
+                startGreen(net, part, next, now);
+            }
+            break;
+        }
+
+        case YELLOW:
+            net->state[lane] = RED;
+            net->lastUpdate[lane] = now;
+            scheduleLane(net, part, lane, now + net->redTime[lane]);
+            break;
+
+        case RED:
+            if (net->greenHolder[k] < 0) {
+                startGreen(net, part, lane, now);
+            } else if (net->waitTail[k] < 0) {
+                net->waitHead[k] = net->waitTail[k] = lane;
+            } else {
+                net->nextWaiting[net->waitTail[k]] = lane;
+                net->waitTail[k] = lane;
+            }
+            break;
+    }
+}
+
+/*
+ * Advances the timer wheel second by second up to the current time and
+ * fires every transition that has come due. Lanes parked in a slot for
+ * a later wheel turn are put back untouched.
+ */
+void updateSignals(Network *net, Partition *part, time_t current) {
+    TimerWheel *w = &part->wheel;
+
+    for (time_t t = w->lastTick + 1; t <= current; t++) {
+        int s = (int)(t & (WHEEL_SLOTS - 1));
+        int lane = w->slot[s];
+        w->slot[s] = -1;
+
+        while (lane >= 0) {
+            int next = net->nextTimer[lane];
+            if (net->due[lane] <= t) {
+                expireLane(net, part, lane, t);
+            } else {
+                net->nextTimer[lane] = w->slot[s];
+                w->slot[s] = lane;
+            }
+            lane = next;
+        }
+    }
+
+    if (current > w->lastTick)
+        w->lastTick = current;
+}
 
 
 /* ============================
-   Logging Function
+   Display Lane
    ============================ */
-void logToFile(Lane lanes[], int laneCount, int currentTimeSec) {
-    FILE *fp = fopen("traffic_log.txt", "a");
+void printLane(const Network *net, int lane) {
+    printf("  Lane %d (intersection %d): %-6s | vehicles = %d\n",
+           lane, net->laneIntersection[lane],
+           stateName(net->state[lane]), net->vehicleCount[lane]);
+}
 
-    if (!fp) {
-        printf("ERROR: Unable to open log file!\n");
-        return;
+void printLanes(const Network *net) {
+    for (int i = 0; i < net->laneCount; i++)
+        printLane(net, i);
+}
+
+
+/* ============================
+   Traffic Stats
+   ============================ */
+typedef struct {
+    long waiting;
+    long processed;
+    int green;
+    double averageDelay;    /* seconds per processed vehicle */
+    double longestWait;     /* seconds */
+    double averageQueue;    /* vehicles waiting per lane, averaged over ticks */
+    double throughput;      /* vehicles processed per simulated second */
+    double perGreenSecond;  /* vehicles processed per second of green */
+    long poolChunks;
+} SimMetrics;
+
+void collectMetrics(const Network *net, SimMetrics *m) {
+    int64_t waitTotal = 0, greenSeconds = 0, queueIntegral = 0;
+    int waitMax = 0;
+
+    memset(m, 0, sizeof(*m));
+    for (int i = 0; i < net->laneCount; i++) {
+        m->waiting += net->vehicleCount[i];
+        m->processed += net->vehiclesProcessed[i];
+        m->green += (net->state[i] == GREEN);
+        waitTotal += net->waitTotal[i];
+        greenSeconds += net->greenSeconds[i];
+        if (net->waitMax[i] > waitMax)
+            waitMax = net->waitMax[i];
     }
 
-    fprintf(fp, "===== Cycle %d (%ld) =====\n",
-            currentTimeSec, time(NULL));
+    int64_t ticks = net->partitions[0].ticks;
+    for (int p = 0; p < net->partitionCount; p++) {
+        queueIntegral += net->partitions[p].queueIntegral;
+        m->poolChunks += net->partitions[p].pool.used;
+    }
+
+    if (m->processed)
+        m->averageDelay = (double)waitTotal / SATURATION_FLOW / m->processed;
+    m->longestWait = (double)waitMax / SATURATION_FLOW;
+    if (ticks) {
+        m->averageQueue = (double)queueIntegral / ticks / net->laneCount;
+        m->throughput = (double)m->processed / ticks;
+    }
+    if (greenSeconds)
+        m->perGreenSecond = (double)m->processed / greenSeconds;
+}
 
-    for (int i = 0; i < laneCount; i++) {
-        const char *stateStr =
-            (lanes[i].state == GREEN)  ? "GREEN"  :
-            (lanes[i].state == YELLOW) ? "YELLOW" : "RED";
+/*
+ * Lists every lane of small networks; large networks only get totals.
+ * Wait times are per processed vehicle; throughput is vehicles released
+ * per second of green.
+ */
+void printStats(const Network *net) {
+    SimMetrics m;
+    collectMetrics(net, &m);
 
-        fprintf(fp,
-                "Lane %d | State: %-6s | Waiting: %d | Processed: %d | "
-                "G=%ds Y=%ds R=%ds\n",
-                lanes[i].laneID,
-                stateStr,
-                lanes[i].vehicleCount,
-                lanes[i].vehiclesProcessed,
-                lanes[i].greenTime,
-                lanes[i].yellowTime,
-                lanes[i].redTime);
+    printf("\n=== Traffic Statistics ===\n");
+    for (int i = 0; i < net->laneCount && net->laneCount <= MAX_LISTED_LANES; i++) {
+        printf("Lane %d:\n", i);
+        printf("  Vehicles waiting     : %d\n", net->vehicleCount[i]);
+        printf("  Vehicles processed   : %d\n", net->vehiclesProcessed[i]);
+        printf("  Average wait         : %.2fs\n",
+               net->vehiclesProcessed[i] ?
+               (double)net->waitTotal[i] / SATURATION_FLOW / net->vehiclesProcessed[i] : 0.0);
+        printf("  Current Light        : %s\n", stateName(net->state[i]));
     }
 
-    fprintf(fp, "\n");
-    fclose(fp);
+    printf("Signal controller      : %s\n", net->controller->name);
+    printf("Intersections          : %d\n", net->intersectionCount);
+    printf("Lanes                  : %d (%d green)\n", net->laneCount, m.green);
+    printf("Total vehicles waiting : %ld\n", m.waiting);
+    printf("Total processed        : %ld\n", m.processed);
+    printf("Average wait           : %.2fs\n", m.averageDelay);
+    printf("Longest wait           : %.1fs\n", m.longestWait);
+    printf("Average queue          : %.3f vehicles per lane\n", m.averageQueue);
+    printf("Throughput             : %.3f vehicles per green second\n",
+           m.perGreenSecond);
+    printf("Vehicle pool           : %ld chunks (%.1f MB)\n", m.poolChunks,
+           m.poolChunks * (double)sizeof(VehicleChunk) / 1e6);
+    printf("==========================\n\n");
 }
 
 
 /* ============================
-   Initialize Lane
+   Emergency Override
    ============================ */
-void initializeLane(Lane *lane, int id, int vehicles) {
-    lane->laneID = id;
-    lane->vehicleCount = vehicles;
-    lane->vehiclesProcessed = 0;
+/*
+ * Forces `laneID` green straight away. Must be called between ticks
+ * with every worker stopped. Returns -1 for an unknown lane.
+ */
+int forceGreen(Network *net, int laneID, time_t now) {
+    if (laneID < 0 || laneID >= net->laneCount)
+        return -1;
+
+    Partition *part = &net->partitions[lanePartition(net, laneID)];
+    int k = net->laneIntersection[laneID];
+
+    /* the lane holding green loses it now, releasing what got through */
+    if (net->greenHolder[k] >= 0)
+        dischargeLane(net, part, net->greenHolder[k], now);
+
+    net->greenHolder[k] = -1;
+    net->waitHead[k] = -1;
+    net->waitTail[k] = -1;
+
+    for (int i = net->laneStart[k]; i < net->laneStart[k + 1]; i++) {
+        unscheduleLane(net, part, i);
+        net->nextWaiting[i] = -1;
+        if (i == laneID) {
+            startGreen(net, part, i, now);
+        } else {
+            net->state[i] = RED;
+            net->lastUpdate[i] = now;
+            scheduleLane(net, part, i, now + net->redTime[i]);
+        }
+    }
+    return 0;
+}
 
-    lane->greenTime = 2 + vehicles;
-    if (lane->greenTime > 5)
-        lane->greenTime = 5;
+void emergencyOverride(Network *net, time_t now) {
+    int laneID;
+    printf("Enter lane ID to force GREEN: ");
+    scanf("%d", &laneID);
 
-    lane->yellowTime = 2;
-    lane->redTime   = 2;
+    if (forceGreen(net, laneID, now) != 0) {
+        printf("Invalid lane ID!\n");
+        return;
+    }
 
-    lane->state = RED;
-    lane->lastUpdate = time(NULL);
+    printf("Emergency Override: Lane %d is NOW GREEN.\n", laneID);
 }
 
 
 /* ============================
-   Update Traffic Signals
+   Live Telemetry
    ============================ */
-void updateSignals(Lane lanes[], int laneCount) {
-    time_t current = time(NULL);
-
-    for (int i = 0; i < laneCount; i++) {
-        Lane *L = &lanes[i];
-        int elapsed = current - L->lastUpdate;
-
-        switch (L->state) {
-            case GREEN:
-                if (elapsed >= L->greenTime) {
-                    L->state = YELLOW;
-                    L->lastUpdate = current;
-                }
-                break;
+/*
+ * A running simulation publishes its per-lane counters into a shared
+ * memory file that any number of dashboards can map and read while it
+ * runs. The region is guarded by a sequence lock: the simulation makes
+ * the sequence odd, copies the counters in, then makes it even again.
+ * Readers copy without locking and retry if the sequence was odd or
+ * moved underneath them, so they never slow the simulation down.
+ *
+ * The same region carries a one-slot command mailbox for emergency
+ * overrides. A client claims the empty slot with a compare-and-swap;
+ * the simulation picks it up between ticks, applies it and echoes the
+ * command back in `ack` before freeing the slot.
+ */
+#define TELEMETRY_MAGIC "TTEL"
+#define TELEMETRY_VERSION 1
+#define OVERRIDE_TIMEOUT_MS 5000
 
-            case YELLOW:
-                if (elapsed >= L->yellowTime) {
-                    L->state = RED;
-                    L->lastUpdate = current;
-                }
-                break;
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    int32_t intersectionCount;
+    int32_t laneCount;
+    _Atomic uint64_t seq;      /* odd while an update is being written */
+    _Atomic int32_t running;   /* 0 once the simulation has stopped */
+    int32_t reserved;
+    int64_t tick;
+    int64_t now;
+    int64_t waiting;
+    int64_t processed;
+    char controller[32];
+    _Atomic uint64_t command;  /* (nonce << 32) | lane, 0 = slot free */
+    _Atomic uint64_t ack;      /* last command applied */
+    _Atomic int32_t ackResult; /* 0 = applied, -1 = unknown lane */
+    int32_t reserved2;
+} TelemetryHeader;
 
-            case RED:
-                if (elapsed >= L->redTime) {
-
-                    int allRed = 1;
-                    for (int j = 0; j < laneCount; j++) {
-                        if (j != i && lanes[j].state == GREEN) {
-                            allRed = 0;
-                            break;
-                        }
-                    }
-
-                    if (allRed) {
-                        L->state = GREEN;
-                        L->vehiclesProcessed += L->vehicleCount;
-                        L->vehicleCount = 0;
-                        L->lastUpdate = current;
-                    }
-                }
-                break;
+typedef struct {
+    int32_t state;
+    int32_t vehicleCount;
+    int32_t vehiclesProcessed;
+    int32_t waitMax;           /* headways */
+    int64_t waitTotal;         /* headways */
+    int64_t greenSeconds;
+} TelemetryLane;
+
+typedef struct Telemetry {
+    TelemetryHeader *header;
+    TelemetryLane *lanes;
+    size_t bytes;
+} Telemetry;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void requestStop(int sig) {
+    (void)sig;
+    stopRequested = 1;
+}
+
+/* Maps a telemetry file. Creates it for `net` if net is not NULL. */
+int telemetryOpen(Telemetry *tel, const char *filename, const Network *net) {
+    memset(tel, 0, sizeof(*tel));
+
+    int fd = open(filename, net ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+    if (fd < 0) {
+        printf("ERROR: Unable to open telemetry %s!\n", filename);
+        return -1;
+    }
+
+    if (net) {
+        tel->bytes = sizeof(TelemetryHeader) +
+                     (size_t)net->laneCount * sizeof(TelemetryLane);
+        if (ftruncate(fd, (off_t)tel->bytes) != 0) {
+            printf("ERROR: Unable to size telemetry %s!\n", filename);
+            close(fd);
+            return -1;
+        }
+    } else {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TelemetryHeader)) {
+            printf("ERROR: %s is not a telemetry file!\n", filename);
+            close(fd);
+            return -1;
+        }
+        tel->bytes = (size_t)st.st_size;
+    }
+
+    void *base = mmap(NULL, tel->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        printf("ERROR: Unable to map telemetry %s!\n", filename);
+        return -1;
+    }
+    tel->header = base;
+    tel->lanes = (TelemetryLane *)(tel->header + 1);
+
+    if (net) {
+        TelemetryHeader *h = tel->header;
+        h->version = TELEMETRY_VERSION;
+        h->intersectionCount = net->intersectionCount;
+        h->laneCount = net->laneCount;
+        snprintf(h->controller, sizeof(h->controller), "%s", net->controller->name);
+        atomic_store(&h->running, 1);
+        atomic_thread_fence(memory_order_release);
+        memcpy(h->magic, TELEMETRY_MAGIC, 4);
+    } else if (memcmp(tel->header->magic, TELEMETRY_MAGIC, 4) != 0 ||
+               tel->header->version != TELEMETRY_VERSION ||
+               tel->bytes < sizeof(TelemetryHeader) +
+                   (size_t)tel->header->laneCount * sizeof(TelemetryLane)) {
+        printf("ERROR: %s is not a telemetry file of this version!\n", filename);
+        munmap(base, tel->bytes);
+        tel->header = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void telemetryClose(Telemetry *tel, int owner) {
+    if (!tel->header)
+        return;
+    if (owner)
+        atomic_store(&tel->header->running, 0);
+    munmap(tel->header, tel->bytes);
+    tel->header = NULL;
+}
+
+/* Copies the current counters in under the sequence lock */
+void telemetryPublish(Telemetry *tel, const Network *net, long tick, time_t now) {
+    TelemetryHeader *h = tel->header;
+    uint64_t seq = atomic_load_explicit(&h->seq, memory_order_relaxed);
+    int64_t waiting = 0, processed = 0;
+
+    atomic_store_explicit(&h->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    for (int i = 0; i < net->laneCount; i++) {
+        TelemetryLane *l = &tel->lanes[i];
+        l->state = net->state[i];
+        l->vehicleCount = net->vehicleCount[i];
+        l->vehiclesProcessed = net->vehiclesProcessed[i];
+        l->waitMax = net->waitMax[i];
+        l->waitTotal = net->waitTotal[i];
+        l->greenSeconds = net->greenSeconds[i];
+        waiting += net->vehicleCount[i];
+        processed += net->vehiclesProcessed[i];
+    }
+    h->tick = tick;
+    h->now = now;
+    h->waiting = waiting;
+    h->processed = processed;
+
+    atomic_store_explicit(&h->seq, seq + 2, memory_order_release);
+}
+
+/* Applies a pending override from the mailbox, if any */
+void telemetryPoll(Telemetry *tel, Network *net, time_t now) {
+    TelemetryHeader *h = tel->header;
+    uint64_t command = atomic_load_explicit(&h->command, memory_order_acquire);
+    if (command == 0)
+        return;
+
+    int lane = (int)(uint32_t)command;
+    int rc = forceGreen(net, lane, now);
+
+    atomic_store_explicit(&h->ackResult, rc, memory_order_relaxed);
+    atomic_store_explicit(&h->ack, command, memory_order_release);
+    atomic_store_explicit(&h->command, 0, memory_order_release);
+}
+
+/*
+ * Takes a consistent copy of the header and up to `maxLanes` lanes.
+ * Returns the number of lanes copied.
+ */
+int telemetryRead(const Telemetry *tel, TelemetryHeader *header,
+                  TelemetryLane *lanes, int maxLanes) {
+    const TelemetryHeader *h = tel->header;
+    int count = 0;
+
+    for (;;) {
+        uint64_t seq = atomic_load_explicit(&h->seq, memory_order_acquire);
+        if (seq & 1)
+            continue;
+
+        header->tick = h->tick;
+        header->now = h->now;
+        header->waiting = h->waiting;
+        header->processed = h->processed;
+        count = h->laneCount < maxLanes ? h->laneCount : maxLanes;
+        memcpy(lanes, tel->lanes, (size_t)count * sizeof(TelemetryLane));
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&h->seq, memory_order_relaxed) == seq)
+            break;
+    }
+    header->laneCount = h->laneCount;
+    header->intersectionCount = h->intersectionCount;
+    memcpy(header->controller, h->controller, sizeof(header->controller));
+    return count;
+}
+
+/* --watch: prints the live counters once a second until the run stops */
+int watchTelemetry(const char *filename) {
+    Telemetry tel;
+    if (telemetryOpen(&tel, filename, NULL) != 0)
+        return 1;
+
+    TelemetryHeader h;
+    TelemetryLane lanes[MAX_LISTED_LANES];
+    signal(SIGINT, requestStop);
+
+    while (!stopRequested) {
+        int running = atomic_load(&tel.header->running);
+        int count = telemetryRead(&tel, &h, lanes, MAX_LISTED_LANES);
+
+        printf("Tick %lld | %s | %d lanes | waiting %lld | processed %lld%s\n",
+               (long long)h.tick, h.controller, h.laneCount,
+               (long long)h.waiting, (long long)h.processed,
+               running ? "" : " | stopped");
+        for (int i = 0; i < count && h.laneCount <= MAX_LISTED_LANES; i++)
+            printf("  Lane %d: %-6s | vehicles = %d | processed = %d\n", i,
+                   stateName((unsigned char)lanes[i].state),
+                   lanes[i].vehicleCount, lanes[i].vehiclesProcessed);
+        fflush(stdout);   /* show each snapshot now, even through a pipe */
+
+        if (!running)
+            break;
+        sleep(1);
+    }
+
+    telemetryClose(&tel, 0);
+    return 0;
+}
+
+/* --override: asks a running simulation to force a lane green */
+int sendOverride(const char *filename, int lane) {
+    Telemetry tel;
+    if (telemetryOpen(&tel, filename, NULL) != 0)
+        return 1;
+
+    TelemetryHeader *h = tel.header;
+    uint64_t nonce = ((uint64_t)getpid() ^ (uint64_t)time(NULL)) & 0x7fffffff;
+    uint64_t command = ((nonce | 1) << 32) | (uint32_t)lane;
+    struct timespec pause = { 0, 1000000 };
+    int waited = 0, rc = 1;
+
+    /* claim the mailbox, then wait for the simulation to echo it back */
+    uint64_t empty = 0;
+    while (!atomic_compare_exchange_weak(&h->command, &empty, command)) {
+        empty = 0;
+        if (++waited > OVERRIDE_TIMEOUT_MS || !atomic_load(&h->running))
+            goto done;
+        nanosleep(&pause, NULL);
+    }
+    while (atomic_load_explicit(&h->ack, memory_order_acquire) != command) {
+        if (++waited > OVERRIDE_TIMEOUT_MS || !atomic_load(&h->running)) {
+            /* withdraw it if still unclaimed */
+            uint64_t mine = command;
+            atomic_compare_exchange_strong(&h->command, &mine, 0);
+            goto done;
         }
+        nanosleep(&pause, NULL);
+    }
+
+    if (atomic_load(&h->ackResult) == 0) {
+        printf("Emergency Override: Lane %d is NOW GREEN.\n", lane);
+        rc = 0;
+    } else {
+        printf("Invalid lane ID!\n");
     }
+
+done:
+    if (rc != 0 && waited > OVERRIDE_TIMEOUT_MS)
+        printf("ERROR: Simulation did not answer the override!\n");
+    else if (rc != 0 && !atomic_load(&h->running))
+        printf("ERROR: Simulation is not running!\n");
+    telemetryClose(&tel, 0);
+    return rc;
 }
 
 
 /* ============================
-   Display Lane
+   Checkpoint / Restore
    ============================ */
-void printLane(const Lane *L) {
-    const char *stateStr =
-        (L->state == GREEN)  ? "GREEN"  :
-        (L->state == YELLOW) ? "YELLOW" : "RED";
+/*
+ * A snapshot is the whole simulation state at a tick boundary:
+ *
+ *   SnapshotHeader
+ *   network arena        (page aligned, copied byte for byte)
+ *   SnapshotPartition[]  (wheel, random streams, pool bookkeeping)
+ *   per partition: VehicleChunk[used], int next[used]
+ *   SnapshotHandoff[]    (vehicles still in flight between partitions)
+ *
+ * Everything inside is index based, so restoring maps the file and
+ * points the network straight into it: no parsing and no per-record
+ * malloc. The mapping is private, so the run can carry on from it
+ * without touching the file.
+ */
+#define SNAPSHOT_MAGIC "TSNP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_PAGE 4096
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    int32_t intersectionCount;
+    int32_t laneCount;
+    int32_t roadCount;
+    int32_t partitionCount;
+    int64_t nextTime;          /* clock value of the next tick */
+    char controller[32];
+    uint64_t arenaOffset;
+    uint64_t arenaBytes;
+    uint64_t partitionOffset;
+    uint64_t handoffOffset;
+    uint64_t handoffCount;
+    uint64_t fileBytes;
+} SnapshotHeader;
+
+typedef struct {
+    Rng rng;
+    Rng arrivalRng;
+    TimerWheel wheel;
+    int64_t queued;
+    int64_t queueIntegral;
+    int64_t ticks;
+    int32_t poolUsed;
+    int32_t poolFreeList;
+    int32_t poolInUse;
+    int32_t reserved;
+    uint64_t chunksOffset;
+    uint64_t nextOffset;
+} SnapshotPartition;
+
+typedef struct {
+    int32_t queue;
+    int32_t reserved;
+    Handoff handoff;
+} SnapshotHandoff;
+
+static uint64_t alignUp(uint64_t value, uint64_t to) {
+    return (value + to - 1) / to * to;
+}
+
+/* Writes `bytes` at `*offset` (after zero padding up to it) */
+static int writeSection(int fd, uint64_t *pos, uint64_t offset,
+                        const void *data, size_t bytes) {
+    static const char zeros[SNAPSHOT_PAGE];
+    while (*pos < offset) {
+        size_t pad = offset - *pos > sizeof(zeros) ? sizeof(zeros) : offset - *pos;
+        if (writeAll(fd, zeros, pad) != 0)
+            return -1;
+        *pos += pad;
+    }
+    if (bytes && writeAll(fd, data, bytes) != 0)
+        return -1;
+    *pos += bytes;
+    return 0;
+}
+
+/*
+ * Saves the simulation to `filename` through a temporary file and a
+ * rename, so a crash mid-write never leaves a torn snapshot behind.
+ * Must be called between ticks with every worker stopped.
+ */
+int writeSnapshot(const Network *net, const char *filename, time_t nextTime) {
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, 4);
+    header.version = SNAPSHOT_VERSION;
+    header.intersectionCount = net->intersectionCount;
+    header.laneCount = net->laneCount;
+    header.roadCount = net->outStart[net->intersectionCount];
+    header.partitionCount = net->partitionCount;
+    header.nextTime = nextTime;
+    snprintf(header.controller, sizeof(header.controller), "%s", net->controller->name);
+
+    Network layout = *net;
+    header.arenaOffset = SNAPSHOT_PAGE;
+    header.arenaBytes = layoutNetwork(&layout, NULL, header.roadCount);
+    header.partitionOffset = alignUp(header.arenaOffset + header.arenaBytes, 64);
+
+    SnapshotPartition *parts = calloc((size_t)net->partitionCount, sizeof(SnapshotPartition));
+    if (!parts) {
+        printf("ERROR: Unable to allocate snapshot!\n");
+        return -1;
+    }
+
+    uint64_t off = alignUp(header.partitionOffset +
+                           (uint64_t)net->partitionCount * sizeof(SnapshotPartition), 64);
+    for (int p = 0; p < net->partitionCount; p++) {
+        const Partition *part = &net->partitions[p];
+        SnapshotPartition *sp = &parts[p];
+        sp->rng = part->rng;
+        sp->arrivalRng = part->arrivalRng;
+        sp->wheel = part->wheel;
+        sp->queued = part->queued;
+        sp->queueIntegral = part->queueIntegral;
+        sp->ticks = part->ticks;
+        sp->poolUsed = part->pool.used;
+        sp->poolFreeList = part->pool.freeList;
+        sp->poolInUse = part->pool.inUse;
+        sp->chunksOffset = off;
+        off = alignUp(off + (uint64_t)part->pool.used * sizeof(VehicleChunk), 64);
+        sp->nextOffset = off;
+        off = alignUp(off + (uint64_t)part->pool.used * sizeof(int), 64);
+    }
+
+    for (int q = 0; q < net->queueCount; q++) {
+        const HandoffQueue *hq = &net->queues[q];
+        header.handoffCount += atomic_load(&hq->tail) - atomic_load(&hq->head);
+        header.handoffCount += (uint64_t)hq->spillCount;
+    }
+    header.handoffOffset = off;
+    header.fileBytes = off + header.handoffCount * sizeof(SnapshotHandoff);
+
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        printf("ERROR: Unable to create snapshot %s!\n", tmp);
+        free(parts);
+        return -1;
+    }
+
+    uint64_t pos = 0;
+    int rc = writeSection(fd, &pos, 0, &header, sizeof(header));
+    if (rc == 0)
+        rc = writeSection(fd, &pos, header.arenaOffset, net->arena, header.arenaBytes);
+    if (rc == 0)
+        rc = writeSection(fd, &pos, header.partitionOffset, parts,
+                          (size_t)net->partitionCount * sizeof(SnapshotPartition));
+    for (int p = 0; rc == 0 && p < net->partitionCount; p++) {
+        const VehiclePool *pool = &net->partitions[p].pool;
+        rc = writeSection(fd, &pos, parts[p].chunksOffset, pool->chunks,
+                          (size_t)pool->used * sizeof(VehicleChunk));
+        if (rc == 0)
+            rc = writeSection(fd, &pos, parts[p].nextOffset, pool->next,
+                              (size_t)pool->used * sizeof(int));
+    }
+    if (rc == 0)
+        rc = writeSection(fd, &pos, header.handoffOffset, NULL, 0);
+    for (int q = 0; rc == 0 && q < net->queueCount; q++) {
+        const HandoffQueue *hq = &net->queues[q];
+        unsigned tail = atomic_load(&hq->tail);
+        for (unsigned h = atomic_load(&hq->head); rc == 0 && h != tail; h++) {
+            SnapshotHandoff sh = { q, 0, hq->ring[h & hq->mask] };
+            rc = writeSection(fd, &pos, pos, &sh, sizeof(sh));
+        }
+        for (int i = 0; rc == 0 && i < hq->spillCount; i++) {
+            SnapshotHandoff sh = { q, 0, hq->spill[i] };
+            rc = writeSection(fd, &pos, pos, &sh, sizeof(sh));
+        }
+    }
+    if (rc == 0)
+        rc = fsync(fd);
+
+    close(fd);
+    free(parts);
+
+    if (rc != 0 || rename(tmp, filename) != 0) {
+        printf("ERROR: Unable to write snapshot %s!\n", filename);
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Maps a snapshot written by writeSnapshot() and rebuilds the network
+ * around it. Partitions and hand-off queues are recreated from the
+ * topology, then their saved state is copied back. Returns 0 and the
+ * clock value of the next tick on success.
+ */
+int restoreSnapshot(Network *net, const char *filename, time_t *nextTime) {
+    memset(net, 0, sizeof(*net));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        printf("ERROR: Unable to open snapshot %s!\n", filename);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        printf("ERROR: %s is not a traffic snapshot!\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    char *base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        printf("ERROR: Unable to map snapshot %s!\n", filename);
+        return -1;
+    }
+
+    SnapshotHeader header;
+    memcpy(&header, base, sizeof(header));
+
+    net->intersectionCount = header.intersectionCount;
+    net->laneCount = header.laneCount;
+    size_t arenaBytes = (header.intersectionCount > 0 && header.laneCount > 0 &&
+                         header.roadCount >= 0)
+                        ? layoutNetwork(net, NULL, header.roadCount) : 0;
+
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, 4) != 0 ||
+        header.version != SNAPSHOT_VERSION ||
+        header.fileBytes != (uint64_t)st.st_size ||
+        header.arenaBytes != arenaBytes || arenaBytes == 0 ||
+        header.arenaOffset % SNAPSHOT_PAGE != 0 ||
+        header.arenaOffset + header.arenaBytes > header.fileBytes ||
+        header.partitionOffset + (uint64_t)header.partitionCount *
+            sizeof(SnapshotPartition) > header.fileBytes ||
+        header.handoffOffset + header.handoffCount *
+            sizeof(SnapshotHandoff) > header.fileBytes ||
+        header.partitionCount < 1) {
+        printf("ERROR: %s is not a valid traffic snapshot of this version!\n", filename);
+        munmap(base, (size_t)st.st_size);
+        memset(net, 0, sizeof(*net));
+        return -1;
+    }
+
+    net->mapping = base;
+    net->mappingSize = (size_t)st.st_size;
+    net->arena = base + header.arenaOffset;
+    layoutNetwork(net, net->arena, header.roadCount);
+
+    header.controller[sizeof(header.controller) - 1] = 0;
+    net->controller = findController(header.controller);
+    if (!net->controller)
+        net->controller = &controllers[0];
+
+    if (partitionNetwork(net, header.partitionCount) != 0 ||
+        net->partitionCount != header.partitionCount) {
+        printf("ERROR: Snapshot partitions do not match its network!\n");
+        freeNetwork(net);
+        return -1;
+    }
+
+    const SnapshotPartition *parts =
+        (const SnapshotPartition *)(base + header.partitionOffset);
+    for (int p = 0; p < net->partitionCount; p++) {
+        Partition *part = &net->partitions[p];
+        const SnapshotPartition *sp = &parts[p];
+
+        if (sp->poolUsed < 0 ||
+            sp->chunksOffset + (uint64_t)sp->poolUsed * sizeof(VehicleChunk) > header.fileBytes ||
+            sp->nextOffset + (uint64_t)sp->poolUsed * sizeof(int) > header.fileBytes) {
+            printf("ERROR: Snapshot vehicle pool %d is corrupt!\n", p);
+            freeNetwork(net);
+            return -1;
+        }
 
-    printf("  Lane %d: %-6s | vehicles = %d\n",
-           L->laneID, stateStr, L->vehicleCount);
+        part->rng = sp->rng;
+        part->arrivalRng = sp->arrivalRng;
+        part->wheel = sp->wheel;
+        part->queued = sp->queued;
+        part->queueIntegral = sp->queueIntegral;
+        part->ticks = sp->ticks;
+        part->pool.chunks = (VehicleChunk *)(base + sp->chunksOffset);
+        part->pool.next = (int *)(base + sp->nextOffset);
+        part->pool.capacity = sp->poolUsed;
+        part->pool.used = sp->poolUsed;
+        part->pool.freeList = sp->poolFreeList;
+        part->pool.inUse = sp->poolInUse;
+        part->pool.borrowed = 1;
+    }
+
+    const SnapshotHandoff *handoffs =
+        (const SnapshotHandoff *)(base + header.handoffOffset);
+    for (uint64_t i = 0; i < header.handoffCount; i++) {
+        if (handoffs[i].queue < 0 || handoffs[i].queue >= net->queueCount)
+            continue;
+        pushHandoff(&net->queues[handoffs[i].queue],
+                    handoffs[i].handoff.lane, handoffs[i].handoff.vehicle);
+    }
+
+    *nextTime = (time_t)header.nextTime;
+    return 0;
 }
 
 
 /* ============================
-   Traffic Stats
+   Run Simulation (with logging)
    ============================ */
-void printStats(Lane lanes[], int size) {
-    printf("\n=== Traffic Statistics ===\n");
-    for (int i = 0; i < size; i++) {
-        printf("Lane %d:\n", lanes[i].laneID);
-        printf("  Vehicles waiting     : %d\n", lanes[i].vehicleCount);
-        printf("  Vehicles processed   : %d\n", lanes[i].vehiclesProcessed);
-        printf("  Current Light        : %s\n",
-               (lanes[i].state == GREEN) ? "GREEN" :
-               (lanes[i].state == YELLOW) ? "YELLOW" : "RED");
+typedef struct {
+    Network *net;
+    SimClock *clk;
+    long ticks;      /* -1 = until interrupted */
+    int threads;
+    int verbose;   /* 1 prints every tick (interactive menu) */
+    LogWriter *log;  /* NULL = logging off */
+    const char *checkpointFile;
+    long checkpointEvery;
+    long firstTick;  /* ticks already simulated before this run */
+    int stop;        /* set by worker 0 once a live run is interrupted */
+    time_t tickTime[2];  /* time of tick t is tickTime[t & 1], set by worker 0 */
+    pthread_barrier_t barrier;
+} SimRun;
+
+typedef struct {
+    SimRun *run;
+    int id;
+} Worker;
+
+static void syncWorkers(SimRun *run) {
+    if (run->threads > 1)
+        pthread_barrier_wait(&run->barrier);
+}
+
+/*
+ * Each tick has two parallel phases separated by barriers: arrivals
+ * (which also drains hand-offs from the previous tick) and signal
+ * updates (which produce the next hand-offs). Worker 0 alone prints,
+ * logs and advances the clock, sampling the next tick's time before
+ * the barrier that closes the signal phase. Logging, telemetry and
+ * checkpoints read the state that tick would change, so when any of
+ * them (or a run-until-stopped) is active a further barrier holds the
+ * other workers until worker 0 has finished; otherwise they go
+ * straight on to the next tick.
+ */
+void *simulationWorker(void *arg) {
+    Worker *w = arg;
+    SimRun *run = w->run;
+    Network *net = run->net;
+
+    for (long t = 0; run->ticks < 0 || t < run->ticks; t++) {
+        time_t now = run->tickTime[t & 1];
+
+        if (w->id == 0 && run->verbose)
+            printf("Time %2ld:\n", t);
+
+        for (int p = w->id; p < net->partitionCount; p += run->threads)
+            addArrivals(net, &net->partitions[p], now);
+        syncWorkers(run);
+
+        if (run->verbose) {
+            if (w->id == 0)
+                printLanes(net);
+            syncWorkers(run);
+        }
+
+        for (int p = w->id; p < net->partitionCount; p += run->threads)
+            updateSignals(net, &net->partitions[p], now);
+        if (w->id == 0) {
+            clockAdvance(run->clk, 1);
+            run->tickTime[(t + 1) & 1] = clockNow(run->clk);
+        }
+        syncWorkers(run);
+
+        int checkpoint = run->checkpointFile && (t + 1) % run->checkpointEvery == 0;
+        if (w->id == 0) {
+            if (run->log)
+                logTick(run->log, net, run->firstTick + t, now); // <-- WRITE TO LOG FILE HERE
+            if (net->telemetry) {
+                telemetryPublish(net->telemetry, net, run->firstTick + t, now);
+                telemetryPoll(net->telemetry, net, run->tickTime[(t + 1) & 1]);
+            }
+            if (checkpoint)
+                writeSnapshot(net, run->checkpointFile, run->tickTime[(t + 1) & 1]);
+            if (run->verbose)
+                printf("\n");
+            if (run->ticks < 0 && stopRequested)
+                run->stop = 1;
+        }
+        if (run->log || checkpoint || net->telemetry || run->ticks < 0)
+            syncWorkers(run);
+        if (run->stop)
+            break;
     }
-    printf("==========================\n\n");
+    return NULL;
+}
+
+/*
+ * Runs the simulation, appending the binary log to `logFile` unless it
+ * is NULL and writing a snapshot to `checkpointFile` (if set) every
+ * `checkpointEvery` ticks. Returns the number of log bytes written.
+ */
+long long runSimulation(Network *net, SimClock *clk, long ticks, int threads,
+                        int verbose, const char *logFile,
+                        const char *checkpointFile, long checkpointEvery) {
+    LogWriter writer;
+    SimRun run = {
+        .net = net, .clk = clk, .ticks = ticks, .threads = threads,
+        .verbose = verbose, .tickTime = { clockNow(clk) },
+        .checkpointFile = checkpointEvery > 0 ? checkpointFile : NULL,
+        .checkpointEvery = checkpointEvery,
+        .firstTick = (long)net->partitions[0].ticks
+    };
+
+    if (logFile) {
+        if (logOpen(&writer, logFile) != 0)
+            return 0;
+        run.log = &writer;
+    }
+
+    if (run.threads > net->partitionCount)
+        run.threads = net->partitionCount;
+    if (run.threads < 1)
+        run.threads = 1;
+
+    Worker *workers = malloc((size_t)run.threads * sizeof(Worker));
+    pthread_t *tids = malloc((size_t)run.threads * sizeof(pthread_t));
+    if (!workers || !tids) {
+        free(workers);
+        free(tids);
+        printf("ERROR: Unable to allocate worker threads!\n");
+        if (run.log)
+            logClose(run.log);
+        return 0;
+    }
+
+    if (run.threads > 1)
+        pthread_barrier_init(&run.barrier, NULL, (unsigned)run.threads);
+
+    for (int i = 0; i < run.threads; i++) {
+        workers[i].run = &run;
+        workers[i].id = i;
+    }
+    for (int i = 1; i < run.threads; i++) {
+        if (pthread_create(&tids[i], NULL, simulationWorker, &workers[i]) != 0) {
+            /* a barrier cannot shrink, so give up before any tick runs */
+            printf("ERROR: Unable to start worker thread %d!\n", i);
+            exit(1);
+        }
+    }
+
+    simulationWorker(&workers[0]);
+
+    for (int i = 1; i < run.threads; i++)
+        pthread_join(tids[i], NULL);
+
+    if (run.threads > 1)
+        pthread_barrier_destroy(&run.barrier);
+    free(workers);
+    free(tids);
+
+    long long logBytes = 0;
+    if (run.log) {
+        logClose(run.log);
+        logBytes = writer.bytesWritten;
+    }
+    return logBytes;
 }
 
 
 /* ============================
-   Emergency Override
+   Command Line
    ============================ */
-void emergencyOverride(Lane lanes[], int laneCount) {
-    int laneID;
-    printf("Enter lane ID to force GREEN: ");
-    scanf("%d", &laneID);
+typedef struct {
+    const char *networkFile;
+    int gridWidth;
+    int gridHeight;
+    long headlessTicks;    /* -1 = interactive menu */
+    unsigned seed;
+    int logging;
+    int threads;
+    int partitions;
+    const char *dumpFile;  /* --dump-log: convert a binary log and exit */
+    const char *dumpOut;
+    const SignalController *controller;
+    int compare;           /* --compare: run every controller on one trace */
+    long benchMaxLanes;    /* --bench: 0 = off */
+    const char *restoreFile;
+    const char *checkpointFile;
+    long checkpointEvery;
+    const char *telemetryFile; /* --telemetry: publish live counters */
+    const char *watchFile;     /* --watch: read another run's telemetry */
+    const char *overrideFile;  /* --override: send it a forced green */
+    int overrideLane;
+} Options;
 
-    if (laneID < 0 || laneID >= laneCount) {
-        printf("Invalid lane ID!\n");
-        return;
-    }
+void printUsage(const char *prog) {
+    printf("Usage: %s [--network <file> | --grid <W>x<H>]\n", prog);
+    printf("       %s --dump-log <log.bin> [out.txt]\n", prog);
+    printf("       %s --bench [<max lanes>] [--headless <ticks>] [--threads <max>]\n", prog);
+    printf("       %s [--network <file> | --grid <W>x<H>] "
+           "--headless <ticks> [--seed <n>] [--log]\n"
+           "           [--threads <n>] [--partitions <n>] "
+           "[--controller <name> | --compare]\n"
+           "           [--checkpoint <file> [--checkpoint-every <ticks>]]\n", prog);
+    printf("       %s --restore <file> --headless <ticks> [...]\n", prog);
+    printf("       %s [--network <file> | --grid <W>x<H>] --telemetry <file> "
+           "[--headless <ticks>] [...]\n", prog);
+    printf("       %s --watch <file>\n", prog);
+    printf("       %s --override <file> <lane>\n", prog);
+    printf("Controllers:");
+    for (int i = 0; i < num_controllers; i++)
+        printf(" %s", controllers[i].name);
+    printf("\n");
+}
 
-    for (int i = 0; i < laneCount; i++) {
-        if (i == laneID) {
-            lanes[i].state = GREEN;
-            lanes[i].vehicleCount = 0;
+int parseOptions(int argc, char *argv[], Options *opt) {
+    opt->networkFile = NULL;
+    opt->gridWidth = 0;
+    opt->gridHeight = 0;
+    opt->headlessTicks = -1;
+    opt->seed = (unsigned)time(NULL);
+    opt->logging = 0;
+    opt->threads = 1;
+    opt->partitions = 64;
+    opt->dumpFile = NULL;
+    opt->dumpOut = NULL;
+    opt->controller = &controllers[0];
+    opt->compare = 0;
+    opt->benchMaxLanes = 0;
+    opt->restoreFile = NULL;
+    opt->checkpointFile = NULL;
+    opt->checkpointEvery = 3600;
+    opt->telemetryFile = NULL;
+    opt->watchFile = NULL;
+    opt->overrideFile = NULL;
+    opt->overrideLane = -1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+            opt->headlessTicks = strtol(argv[++i], NULL, 10);
+            if (opt->headlessTicks < 0)
+                return -1;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            opt->seed = (unsigned)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            opt->threads = atoi(argv[++i]);
+            if (opt->threads < 1)
+                return -1;
+        } else if (strcmp(argv[i], "--partitions") == 0 && i + 1 < argc) {
+            opt->partitions = atoi(argv[++i]);
+            if (opt->partitions < 1)
+                return -1;
+        } else if (strcmp(argv[i], "--dump-log") == 0 && i + 1 < argc) {
+            opt->dumpFile = argv[++i];
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                opt->dumpOut = argv[++i];
+        } else if (strcmp(argv[i], "--controller") == 0 && i + 1 < argc) {
+            opt->controller = findController(argv[++i]);
+            if (!opt->controller)
+                return -1;
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            opt->benchMaxLanes = 1000000;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                opt->benchMaxLanes = strtol(argv[++i], NULL, 10);
+            if (opt->benchMaxLanes < 1)
+                return -1;
+        } else if (strcmp(argv[i], "--restore") == 0 && i + 1 < argc) {
+            opt->restoreFile = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            opt->checkpointFile = argv[++i];
+        } else if (strcmp(argv[i], "--checkpoint-every") == 0 && i + 1 < argc) {
+            opt->checkpointEvery = strtol(argv[++i], NULL, 10);
+            if (opt->checkpointEvery < 1)
+                return -1;
+        } else if (strcmp(argv[i], "--telemetry") == 0 && i + 1 < argc) {
+            opt->telemetryFile = argv[++i];
+        } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc) {
+            opt->watchFile = argv[++i];
+        } else if (strcmp(argv[i], "--override") == 0 && i + 2 < argc) {
+            opt->overrideFile = argv[++i];
+            opt->overrideLane = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--compare") == 0) {
+            opt->compare = 1;
+        } else if (strcmp(argv[i], "--log") == 0) {
+            opt->logging = 1;
+        } else if (strcmp(argv[i], "--network") == 0 && i + 1 < argc) {
+            opt->networkFile = argv[++i];
+        } else if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &opt->gridWidth, &opt->gridHeight) != 2)
+                return -1;
         } else {
-            lanes[i].state = RED;
+            return -1;
         }
-        lanes[i].lastUpdate = time(NULL);
     }
 
-    printf("Emergency Override: Lane %d is NOW GREEN.\n", laneID);
+    /* snapshots run on the virtual clock only */
+    if ((opt->restoreFile || opt->checkpointFile) && opt->headlessTicks < 0)
+        return -1;
+    if ((opt->restoreFile || opt->telemetryFile) && opt->compare)
+        return -1;
+    return 0;
+}
+
+int setupNetwork(Network *net, const Options *opt) {
+    int rc;
+    if (opt->networkFile)
+        rc = loadNetwork(net, opt->networkFile);
+    else if (opt->gridWidth > 0 || opt->gridHeight > 0)
+        rc = gridNetwork(net, opt->gridWidth, opt->gridHeight);
+    else
+        rc = defaultNetwork(net);
+
+    if (rc == 0 && partitionNetwork(net, opt->partitions) != 0) {
+        freeNetwork(net);
+        return -1;
+    }
+    net->controller = opt->controller;
+    return rc;
 }
 
 
 /* ============================
-   Run Simulation (with logging)
+   Headless Batch Mode
+   ============================ */
+/*
+ * Runs the requested number of simulated seconds against a virtual
+ * clock with no sleeps and no per-tick output. Logging is off unless
+ * --log is given, since opening the log file every tick would dominate
+ * the run time.
+ */
+int runHeadless(Network *net, const Options *opt, SimClock *clk) {
+    double start = monotonicSeconds();
+    long long logBytes = runSimulation(net, clk, opt->headlessTicks, opt->threads,
+                                       0, opt->logging ? LOG_FILE : NULL,
+                                       opt->checkpointFile, opt->checkpointEvery);
+    double elapsed = monotonicSeconds() - start;
+
+    printf("Simulation finished (%ld ticks).\n", opt->headlessTicks);
+    printStats(net);
+    printf("Seed: %u | Ticks: %ld | Partitions: %d | Threads: %d | Time: %.3fs",
+           opt->seed, opt->headlessTicks, net->partitionCount,
+           opt->threads, elapsed);
+    if (elapsed > 0)
+        printf(" | %.0f ticks/s", opt->headlessTicks / elapsed);
+    printf("\n");
+    if (opt->logging)
+        printf("Log: %lld bytes", logBytes);
+    if (opt->logging && elapsed > 0)
+        printf(" | %.1f MB/s", logBytes / elapsed / 1e6);
+    if (opt->logging)
+        printf("\n");
+    return 0;
+}
+
+
+/*
+ * Runs every signal controller on the same network, seed and arrival
+ * trace and prints one line of delay, queue and throughput figures each.
+ */
+int runComparison(Network *net, const Options *opt) {
+    SimMetrics results[sizeof(controllers) / sizeof(controllers[0])];
+
+    for (int c = 0; c < num_controllers; c++) {
+        SimClock clk = { 1, 0 };
+        net->controller = &controllers[c];
+        initializeLanes(net, clockNow(&clk), opt->seed);
+        runSimulation(net, &clk, opt->headlessTicks, opt->threads, 0, NULL, NULL, 0);
+        collectMetrics(net, &results[c]);
+    }
+
+    printf("\n=== Controller Comparison (seed %u, %ld ticks, %d lanes) ===\n",
+           opt->seed, opt->headlessTicks, net->laneCount);
+    printf("%-14s %11s %11s %13s %13s\n",
+           "Policy", "Avg delay", "Avg queue", "Vehicles/s", "Per green s");
+    for (int c = 0; c < num_controllers; c++)
+        printf("%-14s %10.2fs %11.3f %13.2f %13.3f\n",
+               controllers[c].name,
+               results[c].averageDelay,
+               results[c].averageQueue,
+               results[c].throughput,
+               results[c].perGreenSecond);
+    return 0;
+}
+
+
+/* ============================
+   Benchmark Harness
    ============================ */
-void runSimulation(Lane lanes[]) {
-    for (int t = 0; t < 10; t++) {
-        printf("Time %2d:\n", t);
+#define BENCH_LOG_FILE "traffic_bench.bin"
+#define BENCH_LANE_TICKS 20000000L
+
+static long peakRssKB(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
 
-        for (int i = 0; i < 2; i++) {
-            int arriving = rand() % 2;
-            lanes[i].vehicleCount += arriving;
+/*
+ * Times headless runs on square grids from ~10 to `benchMaxLanes` lanes
+ * (every factor of ten) and prints one JSON object per grid:
+ *   - ns per lane-tick on one thread without logging
+ *   - binary log throughput on one thread
+ *   - speedup and efficiency for 2, 4, ... up to --threads workers
+ * Ticks per grid default to about 2e7 lane-ticks; --headless overrides.
+ * Peak RSS is the process high-water mark after the grid has run.
+ */
+int runBenchmark(const Options *opt) {
+    int maxThreads = opt->threads;
+    if (maxThreads <= 1) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        maxThreads = cpus > 0 ? (int)cpus : 1;
+    }
+
+    printf("{\n  \"benchmark\": \"traffic_simulator\",\n");
+    printf("  \"seed\": %u,\n  \"controller\": \"%s\",\n",
+           opt->seed, opt->controller->name);
+    printf("  \"partitions\": %d,\n  \"max_threads\": %d,\n",
+           opt->partitions, maxThreads);
+    printf("  \"results\": [");
 
-            lanes[i].greenTime = 2 + lanes[i].vehicleCount;
-            if (lanes[i].greenTime > 5)
-                lanes[i].greenTime = 5;
+    int first = 1;
+    for (long target = 10; target <= opt->benchMaxLanes; target *= 10) {
+        /* every grid intersection has four lanes */
+        int side = 1;
+        while (4L * side * side < target)
+            side++;
+        Network net;
+        if (gridNetwork(&net, side, side) != 0)
+            return 1;
+        if (partitionNetwork(&net, opt->partitions) != 0) {
+            freeNetwork(&net);
+            return 1;
         }
+        net.controller = opt->controller;
 
-        for (int i = 0; i < 2; i++)
-            printLane(&lanes[i]);
+        long ticks = opt->headlessTicks > 0 ? opt->headlessTicks
+                                            : BENCH_LANE_TICKS / net.laneCount;
+        if (ticks < 10)
+            ticks = 10;
+        double laneTicks = (double)ticks * net.laneCount;
 
-        updateSignals(lanes, 2);
+        SimClock clk = { 1, 0 };
+        initializeLanes(&net, clockNow(&clk), opt->seed);
+        double start = monotonicSeconds();
+        runSimulation(&net, &clk, ticks, 1, 0, NULL, NULL, 0);
+        double base = monotonicSeconds() - start;
 
-        logToFile(lanes, 2, t); // <-- WRITE TO LOG FILE HERE
+        unlink(BENCH_LOG_FILE);
+        clk.now = 0;
+        initializeLanes(&net, clockNow(&clk), opt->seed);
+        start = monotonicSeconds();
+        long long logBytes = runSimulation(&net, &clk, ticks, 1, 0, BENCH_LOG_FILE, NULL, 0);
+        double logged = monotonicSeconds() - start;
+        unlink(BENCH_LOG_FILE);
 
-        printf("\n");
-        sleep(1);
+        printf("%s\n    {\"lanes\": %d, \"intersections\": %d, \"ticks\": %ld,",
+               first ? "" : ",", net.laneCount, net.intersectionCount, ticks);
+        printf(" \"seconds\": %.6f, \"ns_per_lane_tick\": %.3f,",
+               base, base * 1e9 / laneTicks);
+        printf(" \"log_seconds\": %.6f, \"log_bytes\": %lld,"
+               " \"log_bytes_per_s\": %.0f,",
+               logged, logBytes, logged > 0 ? logBytes / logged : 0.0);
+        printf("\n     \"scaling\": [{\"threads\": 1, \"seconds\": %.6f,"
+               " \"speedup\": 1.000, \"efficiency\": 1.000}", base);
+
+        for (int threads = 2; threads <= maxThreads; threads *= 2) {
+            clk.now = 0;
+            initializeLanes(&net, clockNow(&clk), opt->seed);
+            start = monotonicSeconds();
+            runSimulation(&net, &clk, ticks, threads, 0, NULL, NULL, 0);
+            double t = monotonicSeconds() - start;
+            int used = threads < net.partitionCount ? threads : net.partitionCount;
+            printf(",\n                 {\"threads\": %d, \"seconds\": %.6f,"
+                   " \"speedup\": %.3f, \"efficiency\": %.3f}",
+                   used, t, base / t, base / t / used);
+        }
+
+        printf("],\n     \"peak_rss_kb\": %ld}", peakRssKB());
+        fflush(stdout);
+        first = 0;
+        freeNetwork(&net);
     }
 
-    printf("Simulation finished. Log saved to traffic_log.txt\n");
+    printf("\n  ]\n}\n");
+    return 0;
+}
+
+
+/* ============================
+   Live Mode
+   ============================ */
+/*
+ * --telemetry without --headless: runs on the wall clock until Ctrl+C,
+ * publishing every tick. Use --watch and --override from another
+ * terminal instead of the menu, which would block the run.
+ */
+int runLive(Network *net, const Options *opt) {
+    SimClock clk = { 0, 0 };
+    struct sigaction sa;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = requestStop;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    initializeLanes(net, clockNow(&clk), opt->seed);
+    printf("Publishing telemetry to %s (Ctrl+C to stop)\n", opt->telemetryFile);
+
+    runSimulation(net, &clk, -1, opt->threads, 0, opt->logging ? LOG_FILE : NULL,
+                  NULL, 0);
+
+    printf("Simulation stopped after %lld ticks.\n",
+           (long long)net->partitions[0].ticks);
+    printStats(net);
+    return 0;
 }
 
 
 /* ============================
    MAIN MENU
    ============================ */
-int main() {
-    Lane lanes[2];
+int main(int argc, char *argv[]) {
+    Options opt;
+    if (parseOptions(argc, argv, &opt) != 0) {
+        printUsage(argv[0]);
+        return 1;
+    }
+
+    if (opt.dumpFile) {
+        FILE *out = opt.dumpOut ? fopen(opt.dumpOut, "w") : stdout;
+        if (!out) {
+            printf("ERROR: Unable to create %s!\n", opt.dumpOut);
+            return 1;
+        }
+        int rc = dumpLog(opt.dumpFile, out);
+        if (out != stdout)
+            fclose(out);
+        return rc == 0 ? 0 : 1;
+    }
+
+    if (opt.benchMaxLanes > 0)
+        return runBenchmark(&opt);
+
+    if (opt.watchFile)
+        return watchTelemetry(opt.watchFile);
+    if (opt.overrideFile)
+        return sendOverride(opt.overrideFile, opt.overrideLane);
+
+    Network net;
+    SimClock virtualClock = { 1, 0 };
+
+    if (opt.restoreFile) {
+        if (restoreSnapshot(&net, opt.restoreFile, &virtualClock.now) != 0)
+            return 1;
+        printf("Restored %s at tick %ld (%d lanes)\n", opt.restoreFile,
+               (long)net.partitions[0].ticks, net.laneCount);
+    } else if (setupNetwork(&net, &opt) != 0) {
+        return 1;
+    } else if (opt.headlessTicks >= 0) {
+        initializeLanes(&net, clockNow(&virtualClock), opt.seed);
+    }
+
+    if (opt.compare && opt.headlessTicks < 0)
+        opt.headlessTicks = 3600;
+
+    Telemetry telemetry;
+    if (opt.telemetryFile) {
+        if (telemetryOpen(&telemetry, opt.telemetryFile, &net) != 0) {
+            freeNetwork(&net);
+            return 1;
+        }
+        net.telemetry = &telemetry;
+    }
+
+    if (opt.headlessTicks >= 0 || opt.telemetryFile) {
+        int rc = opt.compare ? runComparison(&net, &opt)
+               : opt.headlessTicks >= 0 ? runHeadless(&net, &opt, &virtualClock)
+               : runLive(&net, &opt);
+        if (opt.telemetryFile)
+            telemetryClose(&telemetry, 1);
+        freeNetwork(&net);
+        return rc;
+    }
 
-    initializeLane(&lanes[0], 0, 2);
-    initializeLane(&lanes[1], 1, 1);
+    SimClock clk = { 0, 0 };
 
-    srand(time(NULL));
+    initializeLanes(&net, clockNow(&clk), opt.seed);
 
     int choice;
 
@@ -240,26 +2869,31 @@ int main() {
         printf("3. Show traffic statistics\n");
         printf("4. Emergency override (force green)\n");
         printf("5. Exit\n");
+        printf("6. Export log as text\n");
         printf("Choose: ");
         scanf("%d", &choice);
 
         switch (choice) {
             case 1:
-                runSimulation(lanes);
+                runSimulation(&net, &clk, 10, opt.threads, 1, LOG_FILE, NULL, 0);
+                printf("Simulation finished. Log saved to %s\n", LOG_FILE);
                 break;
             case 2:
-                for (int i = 0; i < 2; i++)
-                    printLane(&lanes[i]);
+                printLanes(&net);
                 break;
             case 3:
-                printStats(lanes, 2);
+                printStats(&net);
                 break;
             case 4:
-                emergencyOverride(lanes, 2);
+                emergencyOverride(&net, clockNow(&clk));
                 break;
             case 5:
+                freeNetwork(&net);
                 printf("Exiting...\n");
                 return 0;
+            case 6:
+                exportLog();
+                break;
             default:
                 printf("Invalid choice!\n");
         }